@@ -49,7 +49,6 @@ void decode_tim_capture(TIM_HandleTypeDef *htim, TIM_capture_callback_t callback
 // TODO: move somewhere else
 void pwm_trig_adc_cb(ADC_HandleTypeDef* hadc, bool injected);
 void vbus_sense_adc_cb(ADC_HandleTypeDef* hadc, bool injected);
-void tim_update_cb(TIM_HandleTypeDef* htim);
 void pwm_in_cb(int channel, uint32_t timestamp);
 
 extern TIM_HandleTypeDef htim1;
@@ -268,7 +267,7 @@ void DMA1_Stream5_IRQHandler(void)
 /**
 * @brief This function handles ADC1, ADC2 and ADC3 global interrupts.
 */
-void ADC_IRQHandler(void)
+__RAM_FUNC void ADC_IRQHandler(void)
 {
   /* USER CODE BEGIN ADC_IRQn 0 */
 
@@ -276,7 +275,7 @@ void ADC_IRQHandler(void)
   // So we bypass it and handle the logic ourselves.
   //@TODO add vbus measurement on adc1 here
   ADC_IRQ_Dispatch(&hadc1, &vbus_sense_adc_cb);
-  ADC_IRQ_Dispatch(&hadc2, &pwm_trig_adc_cb);
+  // ADC3 signals the phB (ADC2) and phC (ADC3) samples together
   ADC_IRQ_Dispatch(&hadc3, &pwm_trig_adc_cb);
 
   // Bypass HAL
@@ -430,7 +429,7 @@ void OTG_FS_IRQHandler(void)
 
 /* USER CODE BEGIN 1 */
 
-void ADC_IRQ_Dispatch(ADC_HandleTypeDef* hadc, ADC_handler_t callback) {
+__RAM_FUNC void ADC_IRQ_Dispatch(ADC_HandleTypeDef* hadc, ADC_handler_t callback) {
 
   // Injected measurements
   uint32_t JEOC = __HAL_ADC_GET_FLAG(hadc, ADC_FLAG_JEOC);
@@ -472,8 +471,8 @@ void decode_tim_capture(TIM_HandleTypeDef *htim, TIM_capture_callback_t callback
 */
 void TIM1_UP_TIM10_IRQHandler(void)
 {
+  // The update event only triggers DMA transfers (see start_update_event_dma)
   __HAL_TIM_CLEAR_IT(&htim1, TIM_IT_UPDATE);
-  tim_update_cb(&htim1);
 }
 
 /**
@@ -481,8 +480,8 @@ void TIM1_UP_TIM10_IRQHandler(void)
 */
 void TIM8_UP_TIM13_IRQHandler(void)
 {
+  // The update event only triggers DMA transfers (see start_update_event_dma)
   __HAL_TIM_CLEAR_IT(&htim8, TIM_IT_UPDATE);
-  tim_update_cb(&htim8);
 }
 
 
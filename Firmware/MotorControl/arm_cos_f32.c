@@ -68,7 +68,7 @@
  * @return cos(x).
  */
 
-float32_t our_arm_cos_f32(
+__RAM_FUNC float32_t our_arm_cos_f32(
   float32_t x)
 {
   float32_t cosVal, fract, in;                   /* Temporary variables for input, output */
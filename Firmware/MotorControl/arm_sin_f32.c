@@ -70,7 +70,7 @@
  * @return  sin(x).
  */
 
-float32_t our_arm_sin_f32(
+__RAM_FUNC float32_t our_arm_sin_f32(
   float32_t x)
 {
   float32_t sinVal, fract, in;                           /* Temporary variables for input, output */
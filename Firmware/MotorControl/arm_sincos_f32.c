@@ -0,0 +1,94 @@
+/*
+ * Fused sine and cosine for floating-point values.
+ *
+ * Same table and linear interpolation as our_arm_sin_f32() and
+ * our_arm_cos_f32() (derived from arm_sin_f32.c of the CMSIS DSP library),
+ * but the range reduction and the index calculation are shared between sine
+ * and cosine.
+ */
+
+#include <stm32f4xx_hal.h>  // Sets up the correct chip specifc defines required by arm_math
+#define ARM_MATH_CM4 // TODO: might change in future board versions
+#include "arm_math.h"
+#include "arm_common_tables.h"
+#include <utils.h>
+
+/**
+ * @brief  Fast approximation of sine and cosine of the same angle.
+ * @param[in]  x        input value in radians.
+ * @param[out] sin_val  sin(x).
+ * @param[out] cos_val  cos(x).
+ */
+__RAM_FUNC void our_arm_sincos_f32(float32_t x, float32_t* sin_val, float32_t* cos_val)
+{
+  /* Scale the input to [0 1] range from [0 2*PI] , divide input by 2*pi */
+  float32_t in = x * 0.159154943092f;
+
+  /* Calculation of floor value of input, negative values towards -infinity */
+  int32_t n = (int32_t) in;
+  if (x < 0.0f)
+  {
+    n--;
+  }
+
+  /* Map input value to [0 1] */
+  in = in - (float32_t) n;
+
+  /* Calculation of index of the table */
+  float32_t findex = (float32_t)FAST_MATH_TABLE_SIZE * in;
+  uint16_t index = (uint16_t)findex;
+
+  /* when "in" is exactly 1, we need to rotate the index down to 0 */
+  if (index >= FAST_MATH_TABLE_SIZE) {
+    index = 0;
+    findex -= (float32_t)FAST_MATH_TABLE_SIZE;
+  }
+
+  /* fractional value calculation */
+  float32_t fract = findex - (float32_t) index;
+
+  /* The cosine is the sine a quarter period later, which is a quarter of the
+   * table further at the same fractional position */
+  uint16_t cos_index = (index + FAST_MATH_TABLE_SIZE / 4) & (FAST_MATH_TABLE_SIZE - 1);
+
+  /* Linear interpolation between the two nearest table values */
+  float32_t a = sinTable_f32[index];
+  float32_t b = sinTable_f32[index+1];
+  *sin_val = a + fract * (b - a);
+  a = sinTable_f32[cos_index];
+  b = sinTable_f32[cos_index+1];
+  *cos_val = a + fract * (b - a);
+}
+
+/**
+ * @brief  Fast approximation of sine and cosine of x and of x + delta.
+ *
+ * The second pair is obtained by rotating the first one by delta, using a
+ * truncated Taylor series of sin(delta) and cos(delta). Up to |delta| = 0.75
+ * its error stays below the interpolation error of the table. Larger deltas
+ * fall back to a second table lookup.
+ *
+ * @param[in]  x          input value in radians.
+ * @param[in]  delta      angle increment in radians.
+ * @param[out] sin_x      sin(x).
+ * @param[out] cos_x      cos(x).
+ * @param[out] sin_x_adv  sin(x + delta).
+ * @param[out] cos_x_adv  cos(x + delta).
+ */
+__RAM_FUNC void our_arm_sincos_advance_f32(float32_t x, float32_t delta,
+        float32_t* sin_x, float32_t* cos_x, float32_t* sin_x_adv, float32_t* cos_x_adv)
+{
+  our_arm_sincos_f32(x, sin_x, cos_x);
+
+  if (fabsf(delta) > 0.75f) {
+    our_arm_sincos_f32(x + delta, sin_x_adv, cos_x_adv);
+    return;
+  }
+
+  float32_t d2 = delta * delta;
+  float32_t sin_d = delta * (1.0f - d2 * (1.0f / 6.0f) * (1.0f - d2 * (1.0f / 20.0f) * (1.0f - d2 * (1.0f / 42.0f))));
+  float32_t cos_d = 1.0f - d2 * 0.5f * (1.0f - d2 * (1.0f / 12.0f) * (1.0f - d2 * (1.0f / 30.0f)));
+
+  *sin_x_adv = *sin_x * cos_d + *cos_x * sin_d;
+  *cos_x_adv = *cos_x * cos_d - *sin_x * sin_d;
+}
@@ -1,5 +1,6 @@
 
 #include <stdlib.h>
+#include <algorithm>
 #include <functional>
 #include "gpio.h"
 
@@ -31,6 +32,18 @@ Axis::Axis(const AxisHardwareConfig_t& hw_config,
     update_watchdog_settings();
 }
 
+// @brief Recomputes the values that the control loop derives from the
+// configuration, such as unit conversions and PLL gains.
+// Protocol writes to the config values involved only mark them dirty
+// (invalidate_derived_params). run_control_loop then calls this once before
+// its next iteration, so the control code sees all of them change together.
+void Axis::update_derived_params() {
+    derived_params_dirty_ = false;
+    encoder_.update_derived_params();
+    sensorless_estimator_.update_pll_gains();
+    motor_.update_current_controller_gains();
+}
+
 static void step_cb_wrapper(void* ctx) {
     reinterpret_cast<Axis*>(ctx)->step_cb();
 }
@@ -40,6 +53,9 @@ static void step_cb_wrapper(void* ctx) {
 void Axis::setup() {
     encoder_.setup();
     motor_.setup();
+    // The config is loaded by now, so the derived values are valid before
+    // anything can read them
+    update_derived_params();
 }
 
 static void run_state_machine_loop_wrapper(void* ctx) {
@@ -56,7 +72,7 @@ void Axis::start_thread() {
 
 // @brief Unblocks the control loop thread.
 // This is called from the current sense interrupt handler.
-void Axis::signal_current_meas() {
+__RAM_FUNC void Axis::signal_current_meas() {
     if (thread_id_valid_)
         osSignalSet(thread_id_, M_SIGNAL_PH_CURRENT_MEAS);
 }
@@ -67,6 +83,27 @@ bool Axis::wait_for_current_meas() {
     return osSignalWait(M_SIGNAL_PH_CURRENT_MEAS, PH_CURRENT_MEAS_TIMEOUT).status == osEventSignal;
 }
 
+// @brief Records the state of the current control loop iteration in the
+// flight recorder. The recorder freezes once an error is set.
+void Axis::record_flight_entry() {
+    flight_recorder_.record({
+        .loop_counter = loop_counter_,
+        .axis_error = (uint16_t)error_,
+        .motor_error = (uint16_t)motor_.error_,
+        .timing_adc_cb_i = motor_.timing_log_[Motor::TIMING_LOG_ADC_CB_I],
+        .timing_foc_current = motor_.timing_log_[Motor::TIMING_LOG_FOC_CURRENT],
+        .timing_current_cmd = motor_.timing_log_[Motor::TIMING_LOG_CURRENT_CMD],
+        .current_state = (uint8_t)current_state_,
+        .vbus_voltage = vbus_voltage,
+        .mod_alpha = motor_.next_mod_alpha_,
+        .mod_beta = motor_.next_mod_beta_,
+        .Id_setpoint = motor_.current_control_.Id_setpoint,
+        .Iq_setpoint = motor_.current_control_.Iq_setpoint,
+        .vel_setpoint = controller_.vel_setpoint_,
+        .pos_setpoint = controller_.pos_setpoint_
+    });
+}
+
 // step/direction interface
 void Axis::step_cb() {
     if (step_dir_active_) {
@@ -141,7 +178,8 @@ bool Axis::do_checks() {
         error_ |= ERROR_DC_BUS_OVER_VOLTAGE;
 
     // Sub-components should use set_error which will propegate to this error_
-    motor_.do_checks();
+    if (checks_due_)
+        run_stage(CONTROL_STAGE_CHECKS, [this]() { return motor_.do_checks(); });
     encoder_.do_checks();
     // sensorless_estimator_.do_checks();
     // controller_.do_checks();
@@ -152,11 +190,56 @@ bool Axis::do_checks() {
 // @brief Update all esitmators
 bool Axis::do_updates() {
     // Sub-components should use set_error which will propegate to this error_
-    encoder_.update();
-    sensorless_estimator_.update();
+    run_stage(CONTROL_STAGE_ESTIMATORS, [this]() {
+        if (encoder_due_) {
+            encoder_.update((float)(encoder_age_ + 1) * current_meas_period);
+            encoder_age_ = 0;
+        } else {
+            ++encoder_age_;
+        }
+        // The flux observer integrates the applied voltage of every
+        // control period, so it always runs at the full rate.
+        sensorless_estimator_.update();
+        return true;
+    });
     return check_for_errors();
 }
 
+// @brief Decides which of the decimated stages run in this iteration of the control loop.
+// Outside of closed loop and sensorless control, every stage runs on every iteration.
+void Axis::schedule_stages() {
+    bool multi_rate = current_state_ == AXIS_STATE_CLOSED_LOOP_CONTROL
+                   || current_state_ == AXIS_STATE_SENSORLESS_CONTROL;
+    uint32_t tick = scheduler_tick_++;
+    auto is_due = [&](uint32_t decimation, uint32_t offset) {
+        return !multi_rate || decimation <= 1 || (tick % decimation) == offset;
+    };
+    // Hall transitions are decoded from the state change since the last
+    // update, so a hall encoder must be sampled on every iteration.
+    uint32_t encoder_decimation = encoder_.config_.mode == Encoder::MODE_HALL ? 1 : config_.encoder_decimation;
+    encoder_due_ = is_due(encoder_decimation, 0);
+    controller_due_ = is_due(config_.controller_decimation, 0);
+    // Shift the checks by half a period so they don't land in the same
+    // iterations as the encoder and controller updates.
+    checks_due_ = is_due(config_.checks_decimation, config_.checks_decimation / 2);
+}
+
+// @brief Time between two controller updates [s]
+float Axis::controller_period() {
+    return (float)std::max<uint32_t>(config_.controller_decimation, 1) * current_meas_period;
+}
+
+// @brief Updates the execution time statistics of the given stage.
+// @param start: value of timing_clocks_now() when the stage started.
+// Stages that take longer than one control period wrap around.
+void Axis::record_stage_cost(ControlStage_t stage, uint16_t start) {
+    uint16_t period_clocks = 2 * tim_1_8_period_clocks * (tim_1_8_rcr + 1);
+    uint16_t cost = (timing_clocks_now() + period_clocks - start) % period_clocks;
+    stage_cost_[stage].last = cost;
+    if (cost > stage_cost_[stage].max)
+        stage_cost_[stage].max = cost;
+}
+
 // @brief Feed the watchdog to prevent watchdog timeouts.
 void Axis::watchdog_feed() {
     watchdog_current_value_ = watchdog_reset_value_;
@@ -247,10 +330,14 @@ bool Axis::run_sensorless_control_loop() {
             return error_ |= ERROR_POS_CTRL_DURING_SENSORLESS, false;
 
         // Note that all estimators are updated in the loop prefix in run_control_loop
-        float current_setpoint;
-        if (!controller_.update(sensorless_estimator_.pll_pos_, sensorless_estimator_.vel_estimate_, &current_setpoint))
+        if (controller_due_ && !run_stage(CONTROL_STAGE_CONTROLLER, [this]() {
+                return controller_.update(sensorless_estimator_.pll_pos_, sensorless_estimator_.vel_estimate_,
+                                          controller_period(), &current_setpoint_);
+            }))
             return error_ |= ERROR_CONTROLLER_FAILED, false;
-        if (!motor_.update(current_setpoint, sensorless_estimator_.phase_, sensorless_estimator_.vel_estimate_))
+        if (!run_stage(CONTROL_STAGE_CURRENT_CONTROL, [this]() {
+                return motor_.update(current_setpoint_, sensorless_estimator_.phase_, sensorless_estimator_.vel_estimate_);
+            }))
             return false; // set_error should update axis.error_
         return true;
     });
@@ -263,11 +350,17 @@ bool Axis::run_closed_loop_control_loop() {
     set_step_dir_active(config_.enable_step_dir);
     run_control_loop([this](){
         // Note that all estimators are updated in the loop prefix in run_control_loop
-        float current_setpoint;
-        if (!controller_.update(encoder_.pos_estimate_, encoder_.vel_estimate_, &current_setpoint))
+        if (controller_due_ && !run_stage(CONTROL_STAGE_CONTROLLER, [this]() {
+                return controller_.update(encoder_.pos_estimate_, encoder_.vel_estimate_,
+                                          controller_period(), &current_setpoint_);
+            }))
             return error_ |= ERROR_CONTROLLER_FAILED, false; //TODO: Make controller.set_error
-        float phase_vel = 2*M_PI * encoder_.vel_estimate_ / (float)encoder_.config_.cpr * motor_.config_.pole_pairs;
-        if (!motor_.update(current_setpoint, encoder_.phase_, phase_vel))
+        float phase_vel = encoder_.elec_rad_per_enc_ * encoder_.vel_estimate_;
+        // Extrapolate the phase if the encoder was not updated in this iteration
+        float phase = encoder_.phase_ + (float)encoder_age_ * current_meas_period * phase_vel;
+        if (!run_stage(CONTROL_STAGE_CURRENT_CONTROL, [&]() {
+                return motor_.update(current_setpoint_, phase, phase_vel);
+            }))
             return false; // set_error should update axis.error_
         return true;
     });
@@ -344,6 +437,12 @@ void Axis::run_state_machine_loop() {
                 status = motor_.run_calibration();
             } break;
 
+            case AXIS_STATE_INDUCTANCE_MAP_CALIBRATION: {
+                if (!motor_.is_calibrated_)
+                    goto invalid_state_label;
+                status = motor_.run_inductance_map_calibration();
+            } break;
+
             case AXIS_STATE_ENCODER_INDEX_SEARCH: {
                 if (!motor_.is_calibrated_)
                     goto invalid_state_label;
@@ -35,6 +35,7 @@ public:
         AXIS_STATE_CLOSED_LOOP_CONTROL = 8,  //<! run closed loop control
         AXIS_STATE_LOCKIN_SPIN = 9,       //<! run lockin spin
         AXIS_STATE_ENCODER_DIR_FIND = 10,
+        AXIS_STATE_INDUCTANCE_MAP_CALIBRATION = 11, //<! measure the current dependence of the inductance
     };
 
     struct LockinConfig_t {
@@ -62,6 +63,13 @@ public:
 
         float watchdog_timeout = 0.0f; // [s] (0 disables watchdog)
 
+        // Multi-rate scheduling in closed loop and sensorless control:
+        // the stages below only run on every n-th current measurement.
+        // The current controller always runs on every measurement.
+        uint32_t encoder_decimation = 1;    //<! encoder PLL, ignored (always 1) in hall mode
+        uint32_t controller_decimation = 1; //<! position/velocity controller
+        uint32_t checks_decimation = 1;     //<! motor checks (DRV fault, thermal limits)
+
         // Defaults loaded from hw_config in load_configuration in main.cpp
         uint16_t step_gpio_pin = 0;
         uint16_t dir_gpio_pin = 0;
@@ -73,6 +81,21 @@ public:
         M_SIGNAL_PH_CURRENT_MEAS = 1u << 0
     };
 
+    enum ControlStage_t {
+        CONTROL_STAGE_CHECKS,
+        CONTROL_STAGE_ESTIMATORS,
+        CONTROL_STAGE_CONTROLLER,
+        CONTROL_STAGE_CURRENT_CONTROL,
+        CONTROL_STAGE_NUM_STAGES
+    };
+    static_assert(Profiler::SLOT_CURRENT_CONTROL - Profiler::SLOT_CHECKS == CONTROL_STAGE_CURRENT_CONTROL,
+                  "the profiler slots of the control stages must be in the same order");
+
+    struct StageCost_t {
+        uint16_t last; // [clocks] execution time the last time the stage ran
+        uint16_t max;  // [clocks] write 0 to reset
+    };
+
     enum LockinState_t {
         LOCKIN_STATE_INACTIVE,
         LOCKIN_STATE_RAMP,
@@ -92,19 +115,36 @@ public:
     void start_thread();
     void signal_current_meas();
     bool wait_for_current_meas();
+    void record_flight_entry();
 
     void step_cb();
     void set_step_dir_active(bool enable);
     void decode_step_dir_pins();
     void update_watchdog_settings();
+    void invalidate_derived_params() { derived_params_dirty_ = true; }
+    void update_derived_params();
 
     static void load_default_step_dir_pin_config(
         const AxisHardwareConfig_t& hw_config, Config_t* config);
 
     bool check_DRV_fault();
     bool check_PSU_brownout();
+    void schedule_stages();
     bool do_checks();
     bool do_updates();
+    void record_stage_cost(ControlStage_t stage, uint16_t start);
+    float controller_period();
+
+    // @brief Runs fn and records its execution time for the given stage
+    template<typename T>
+    bool run_stage(ControlStage_t stage, const T& fn) {
+        uint16_t start = timing_clocks_now();
+        uint32_t start_cycles = cycles_now();
+        bool result = fn();
+        record_stage_cost(stage, start);
+        profiler_.record_stage((Profiler::Slot_t)(Profiler::SLOT_CHECKS + stage), start_cycles);
+        return result;
+    }
 
     void watchdog_feed();
     bool watchdog_check();
@@ -117,6 +157,11 @@ public:
 
     // @brief Runs the specified update handler at the frequency of the current measurements.
     //
+    // In closed loop and sensorless control, the encoder, the controller and the
+    // motor checks run at integer fractions of this frequency as configured by
+    // config_.*_decimation (see schedule_stages). The update handler checks
+    // controller_due_ and must call the motor update on every iteration.
+    //
     // The loop runs until one of the following conditions:
     //  - update_handler returns false
     //  - the current measurement times out
@@ -137,7 +182,15 @@ public:
     // @tparam T Must be a callable type that takes no arguments and returns a bool
     template<typename T>
     void run_control_loop(const T& update_handler) {
+        scheduler_tick_ = 0;
         while (requested_state_ == AXIS_STATE_UNDEFINED) {
+            // Apply config changes made since the last iteration
+            if (derived_params_dirty_)
+                update_derived_params();
+
+            // Decide which of the decimated stages run in this iteration
+            schedule_stages();
+
             // look for errors at axis level and also all subcomponents
             bool checks_ok = do_checks();
             // Update all estimators
@@ -150,8 +203,10 @@ public:
             if (!checks_ok || !updates_ok || !watchdog_ok) {
                 // It's not useful to quit idle since that is the safe action
                 // Also leaving idle would rearm the motors
-                if (current_state_ != AXIS_STATE_IDLE)
+                if (current_state_ != AXIS_STATE_IDLE) {
+                    record_flight_entry();
                     break;
+                }
             }
 
             // Run main loop function, defer quitting for after wait
@@ -160,6 +215,8 @@ public:
 
             // Check we meet deadlines after queueing
             ++loop_counter_;
+            profiler_.end_iteration();
+            record_flight_entry();
 
             // Wait until the current measurement interrupt fires
             if (!wait_for_current_meas()) {
@@ -168,8 +225,10 @@ public:
                 safety_critical_disarm_motor_pwm(motor_);
                 update_brake_current();
                 error_ |= ERROR_CURRENT_MEASUREMENT_TIMEOUT;
+                record_flight_entry();
                 break;
             }
+            profiler_.start_iteration();
 
             if (!main_continue)
                 break;
@@ -211,6 +270,18 @@ public:
     uint32_t loop_counter_ = 0;
     LockinState_t lockin_state_ = LOCKIN_STATE_INACTIVE;
 
+    // multi-rate scheduling, updated by schedule_stages()
+    volatile bool derived_params_dirty_ = true; // see invalidate_derived_params()
+    uint32_t scheduler_tick_ = 0; // [current measurements] since run_control_loop started
+    bool checks_due_ = true;
+    bool encoder_due_ = true;
+    bool controller_due_ = true;
+    uint32_t encoder_age_ = 0; // [current measurements] since the encoder was last updated
+    float current_setpoint_ = 0.0f; // [A] controller output, held between controller updates
+    StageCost_t stage_cost_[CONTROL_STAGE_NUM_STAGES] = {};
+    Profiler profiler_;
+    FlightRecorder flight_recorder_;
+
     // watchdog
     uint32_t watchdog_reset_value_ = 0; //computed from config_.watchdog_timeout in update_watchdog_settings()
     uint32_t watchdog_current_value_= 0;
@@ -224,6 +295,18 @@ public:
             make_protocol_property("requested_state", &requested_state_),
             make_protocol_ro_property("loop_counter", &loop_counter_),
             make_protocol_ro_property("lockin_state", &lockin_state_),
+            make_protocol_object("stage_cost",
+                make_protocol_ro_property("checks_last", &stage_cost_[CONTROL_STAGE_CHECKS].last),
+                make_protocol_property("checks_max", &stage_cost_[CONTROL_STAGE_CHECKS].max),
+                make_protocol_ro_property("estimators_last", &stage_cost_[CONTROL_STAGE_ESTIMATORS].last),
+                make_protocol_property("estimators_max", &stage_cost_[CONTROL_STAGE_ESTIMATORS].max),
+                make_protocol_ro_property("controller_last", &stage_cost_[CONTROL_STAGE_CONTROLLER].last),
+                make_protocol_property("controller_max", &stage_cost_[CONTROL_STAGE_CONTROLLER].max),
+                make_protocol_ro_property("current_control_last", &stage_cost_[CONTROL_STAGE_CURRENT_CONTROL].last),
+                make_protocol_property("current_control_max", &stage_cost_[CONTROL_STAGE_CURRENT_CONTROL].max)
+            ),
+            make_protocol_object("profiler", profiler_.make_protocol_definitions()),
+            make_protocol_object("flight_recorder", flight_recorder_.make_protocol_definitions()),
             make_protocol_object("config",
                 make_protocol_property("startup_motor_calibration", &config_.startup_motor_calibration),
                 make_protocol_property("startup_encoder_index_search", &config_.startup_encoder_index_search),
@@ -234,6 +317,9 @@ public:
                 make_protocol_property("counts_per_step", &config_.counts_per_step),
                 make_protocol_property("watchdog_timeout", &config_.watchdog_timeout,
                     [](void* ctx) { static_cast<Axis*>(ctx)->update_watchdog_settings(); }, this),
+                make_protocol_property("encoder_decimation", &config_.encoder_decimation),
+                make_protocol_property("controller_decimation", &config_.controller_decimation),
+                make_protocol_property("checks_decimation", &config_.checks_decimation),
                 make_protocol_property("step_gpio_pin", &config_.step_gpio_pin,
                     [](void* ctx) { static_cast<Axis*>(ctx)->decode_step_dir_pins(); }, this),
                 make_protocol_property("dir_gpio_pin", &config_.dir_gpio_pin,
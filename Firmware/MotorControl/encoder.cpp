@@ -78,6 +78,25 @@ void Encoder::update_pll_gains() {
     }
 }
 
+void Encoder::update_derived_params() {
+    rad_per_enc_ = (2.0f * (float)M_PI) * (1.0f / (float)(config_.cpr));
+    elec_rad_per_enc_ = (float)axis_->motor_.config_.pole_pairs * rad_per_enc_;
+}
+
+void Encoder::invalidate_derived_params() {
+    if (axis_)
+        axis_->invalidate_derived_params();
+}
+
+// @brief Applies pos_estimate_ and pos_cpr_ to the PLL, after they were
+// written through the protocol.
+void Encoder::load_pos_estimates() {
+    uint32_t prim = cpu_enter_critical();
+    pll_pos_ = count_pos_from_float(pos_estimate_);
+    pll_pos_cpr_ = count_pos_from_float(fmodf_pos(pos_cpr_, (float)(config_.cpr)));
+    cpu_exit_critical(prim);
+}
+
 void Encoder::check_pre_calibrated() {
     if (!is_ready_)
         config_.pre_calibrated = false;
@@ -92,6 +111,7 @@ void Encoder::set_linear_count(int32_t count) {
 
     // Update states
     shadow_count_ = count;
+    pll_pos_ = { count, 0.0f };
     pos_estimate_ = (float)count;
     //Write hardware last
     hw_config_.timer->Instance->CNT = count;
@@ -112,6 +132,7 @@ void Encoder::set_circular_count(int32_t count, bool update_offset) {
 
     // Update states
     count_in_cpr_ = mod(count, config_.cpr);
+    pll_pos_cpr_ = { count_in_cpr_, 0.0f };
     pos_cpr_ = (float)count_in_cpr_;
 
     cpu_exit_critical(prim);
@@ -200,8 +221,10 @@ bool Encoder::run_offset_calibration() {
     i = 0;
     axis_->run_control_loop([&](){
         float phase = wrap_pm_pi(config_.calib_scan_distance * (float)i / (float)num_steps - config_.calib_scan_distance / 2.0f);
-        float v_alpha = voltage_magnitude * our_arm_cos_f32(phase);
-        float v_beta = voltage_magnitude * our_arm_sin_f32(phase);
+        float c, s;
+        our_arm_sincos_f32(phase, &s, &c);
+        float v_alpha = voltage_magnitude * c;
+        float v_beta = voltage_magnitude * s;
         if (!axis_->motor_.enqueue_voltage_timings(v_alpha, v_beta))
             return false; // error set inside enqueue_voltage_timings
         axis_->motor_.log_timing(Motor::TIMING_LOG_ENC_CALIB);
@@ -226,10 +249,8 @@ bool Encoder::run_offset_calibration() {
         return false;
     }
 
-    //TODO avoid recomputing elec_rad_per_enc every time
     // Check CPR
-    float elec_rad_per_enc = axis_->motor_.config_.pole_pairs * 2 * M_PI * (1.0f / (float)(config_.cpr));
-    float expected_encoder_delta = config_.calib_scan_distance / elec_rad_per_enc;
+    float expected_encoder_delta = config_.calib_scan_distance / elec_rad_per_enc_;
     calib_scan_response_ = fabsf(shadow_count_-init_enc_val);
     if(fabsf(calib_scan_response_ - expected_encoder_delta)/expected_encoder_delta > config_.calib_range)
     {
@@ -241,8 +262,10 @@ bool Encoder::run_offset_calibration() {
     i = 0;
     axis_->run_control_loop([&](){
         float phase = wrap_pm_pi(-config_.calib_scan_distance * (float)i / (float)num_steps + config_.calib_scan_distance / 2.0f);
-        float v_alpha = voltage_magnitude * our_arm_cos_f32(phase);
-        float v_beta = voltage_magnitude * our_arm_sin_f32(phase);
+        float c, s;
+        our_arm_sincos_f32(phase, &s, &c);
+        float v_alpha = voltage_magnitude * c;
+        float v_beta = voltage_magnitude * s;
         if (!axis_->motor_.enqueue_voltage_timings(v_alpha, v_beta))
             return false; // error set inside enqueue_voltage_timings
         axis_->motor_.log_timing(Motor::TIMING_LOG_ENC_CALIB);
@@ -262,22 +285,29 @@ bool Encoder::run_offset_calibration() {
     return true;
 }
 
-static bool decode_hall(uint8_t hall_state, int32_t* hall_cnt) {
-    switch (hall_state) {
-        case 0b001: *hall_cnt = 0; return true;
-        case 0b011: *hall_cnt = 1; return true;
-        case 0b010: *hall_cnt = 2; return true;
-        case 0b110: *hall_cnt = 3; return true;
-        case 0b100: *hall_cnt = 4; return true;
-        case 0b101: *hall_cnt = 5; return true;
-        default: return false;
-    }
-}
-
-void Encoder::sample_now() {
+// Change of the hall count from the previous count (count_in_cpr % 6) to the
+// count of the sampled hall state (bit[0] = HallA, .., bit[2] = HallC).
+// The hall states 0b001, 0b011, 0b010, 0b110, 0b100, 0b101 are the counts 0 to 5.
+// A change of 3 counts skips two states and its direction can't be told from
+// the states alone (HALL_AMBIGUOUS). 0b000 and 0b111 are illegal (HALL_ILLEGAL).
+static constexpr int8_t HALL_ILLEGAL = INT8_MIN;
+static constexpr int8_t HALL_AMBIGUOUS = 3;
+static const int8_t hall_cnt_delta[6][8] = {
+    //  000            001             010             011             100             101             110             111
+    { HALL_ILLEGAL,  0,              2,              1,             -2,             -1,              HALL_AMBIGUOUS, HALL_ILLEGAL },
+    { HALL_ILLEGAL, -1,              1,              0,              HALL_AMBIGUOUS,-2,              2,              HALL_ILLEGAL },
+    { HALL_ILLEGAL, -2,              0,             -1,              2,              HALL_AMBIGUOUS, 1,              HALL_ILLEGAL },
+    { HALL_ILLEGAL,  HALL_AMBIGUOUS,-1,             -2,              1,              2,              0,              HALL_ILLEGAL },
+    { HALL_ILLEGAL,  2,             -2,              HALL_AMBIGUOUS, 0,              1,             -1,              HALL_ILLEGAL },
+    { HALL_ILLEGAL,  1,              HALL_AMBIGUOUS, 2,             -1,              0,             -2,              HALL_ILLEGAL },
+};
+
+// @brief Latches the encoder reading of the current measurement.
+// @param tim_cnt: encoder timer count, captured by DMA at the update event
+__RAM_FUNC void Encoder::sample_now(uint16_t tim_cnt) {
     switch (config_.mode) {
         case MODE_INCREMENTAL: {
-            tim_cnt_sample_ = (int16_t)hw_config_.timer->Instance->CNT;
+            tim_cnt_sample_ = (int16_t)tim_cnt;
         } break;
 
         case MODE_HALL: {
@@ -295,7 +325,9 @@ void Encoder::sample_now() {
     }
 }
 
-bool Encoder::update() {
+// @brief Updates the position and velocity estimates from the latest sample.
+// @param dt: time since the last update [s]
+__RAM_FUNC bool Encoder::update(float dt) {
     // update internal encoder state.
     int32_t delta_enc = 0;
     switch (config_.mode) {
@@ -307,17 +339,17 @@ bool Encoder::update() {
         } break;
 
         case MODE_HALL: {
-            int32_t hall_cnt;
-            if (decode_hall(hall_state_, &hall_cnt)) {
-                delta_enc = hall_cnt - count_in_cpr_;
-                delta_enc = mod(delta_enc, 6);
-                if (delta_enc > 3)
-                    delta_enc -= 6;
-            } else {
+            int8_t delta_hall = hall_cnt_delta[mod(count_in_cpr_, 6)][hall_state_ & 0b111];
+            if (delta_hall == HALL_ILLEGAL) {
                 if (!config_.ignore_illegal_hall_state) {
                     set_error(ERROR_ILLEGAL_HALL_STATE);
                     return false;
                 }
+            } else if (delta_hall == HALL_AMBIGUOUS) {
+                // Missed two edges: assume we kept turning in the same direction
+                delta_enc = (vel_estimate_ < 0.0f) ? -3 : 3;
+            } else {
+                delta_enc = delta_hall;
             }
         } break;
 
@@ -343,23 +375,17 @@ bool Encoder::update() {
     count_in_cpr_ = mod(count_in_cpr_, config_.cpr);
 
     //// run pll (for now pll is in units of encoder counts)
-    // Predict current pos
-    pos_estimate_ += current_meas_period * vel_estimate_;
-    pos_cpr_      += current_meas_period * vel_estimate_;
-    // discrete phase detector
-    float delta_pos     = (float)(shadow_count_ - (int32_t)floorf(pos_estimate_));
-    float delta_pos_cpr = (float)(count_in_cpr_ - (int32_t)floorf(pos_cpr_));
-    delta_pos_cpr = wrap_pm(delta_pos_cpr, 0.5f * (float)(config_.cpr));
-    // pll feedback
-    pos_estimate_ += current_meas_period * pll_kp_ * delta_pos;
-    pos_cpr_      += current_meas_period * pll_kp_ * delta_pos_cpr;
-    pos_cpr_ = fmodf_pos(pos_cpr_, (float)(config_.cpr));
-    vel_estimate_      += current_meas_period * pll_ki_ * delta_pos_cpr;
-    bool snap_to_zero_vel = false;
-    if (fabsf(vel_estimate_) < 0.5f * current_meas_period * pll_ki_) {
-        vel_estimate_ = 0.0f; //align delta-sigma on zero to prevent jitter
-        snap_to_zero_vel = true;
+    // The update may be decimated (see Axis::Config_t::encoder_decimation),
+    // except in hall mode
+    if (!(dt * pll_kp_ < 1.0f)) {
+        set_error(ERROR_UNSTABLE_GAIN);
+        return false;
     }
+    bool snap_to_zero_vel = encoder_pll_update(pll_pos_, pll_pos_cpr_, vel_estimate_,
+                                               shadow_count_, count_in_cpr_, config_.cpr,
+                                               dt, pll_kp_, pll_ki_);
+    pos_estimate_ = count_pos_to_float(pll_pos_);
+    pos_cpr_      = count_pos_to_float(pll_pos_cpr_);
 
     //// run encoder count interpolation
     int32_t corrected_enc = count_in_cpr_ - config_.offset;
@@ -373,18 +399,18 @@ bool Encoder::update() {
         interpolation_ = 1.0f;
     } else {
         // Interpolate (predict) between encoder counts using vel_estimate,
-        interpolation_ += current_meas_period * vel_estimate_;
+        interpolation_ += dt * vel_estimate_;
         // don't allow interpolation indicated position outside of [enc, enc+1)
         if (interpolation_ > 1.0f) interpolation_ = 1.0f;
         if (interpolation_ < 0.0f) interpolation_ = 0.0f;
     }
-    float interpolated_enc = corrected_enc + interpolation_;
 
     //// compute electrical phase
-    //TODO avoid recomputing elec_rad_per_enc every time
-    float elec_rad_per_enc = axis_->motor_.config_.pole_pairs * 2 * M_PI * (1.0f / (float)(config_.cpr));
-    float ph = elec_rad_per_enc * (interpolated_enc - config_.offset_float);
-    // ph = fmodf(ph, 2*M_PI);
+    // The integer part is reduced to one electrical revolution first, so
+    // the phase stays within a period and wraps in a single step.
+    int32_t pole_pairs = axis_->motor_.config_.pole_pairs;
+    int32_t elec_count = mod(corrected_enc * pole_pairs, config_.cpr);
+    float ph = rad_per_enc_ * ((float)elec_count + (float)pole_pairs * (interpolation_ - config_.offset_float));
     phase_ = wrap_pm_pi(ph);
 
     return true;
@@ -55,6 +55,9 @@ public:
     void enc_index_cb();
     void set_idx_subscribe(bool override_enable = false);
     void update_pll_gains();
+    void update_derived_params();
+    void invalidate_derived_params();
+    void load_pos_estimates();
     void check_pre_calibrated();
 
     void set_linear_count(int32_t count);
@@ -64,8 +67,8 @@ public:
     bool run_index_search();
     bool run_direction_find();
     bool run_offset_calibration();
-    void sample_now();
-    bool update();
+    void sample_now(uint16_t tim_cnt);
+    bool update(float dt);
 
 
 
@@ -80,11 +83,15 @@ public:
     int32_t count_in_cpr_ = 0;
     float interpolation_ = 0.0f;
     float phase_ = 0.0f;    // [count]
-    float pos_estimate_ = 0.0f;  // [count]
-    float pos_cpr_ = 0.0f;  // [count]
+    float pos_estimate_ = 0.0f;  // [count] copy of pll_pos_
+    float pos_cpr_ = 0.0f;  // [count] copy of pll_pos_cpr_
+    CountPos_t pll_pos_ = { 0, 0.0f };  // [count]
+    CountPos_t pll_pos_cpr_ = { 0, 0.0f };  // [count]
     float vel_estimate_ = 0.0f;  // [count/s]
     float pll_kp_ = 0.0f;   // [count/s / count]
     float pll_ki_ = 0.0f;   // [(count/s^2) / count]
+    float rad_per_enc_ = 0.0f;  // [rad/count] computed from config_.cpr in update_derived_params()
+    float elec_rad_per_enc_ = 0.0f;  // [rad/count] electrical, also depends on the pole pairs
     float calib_scan_response_ = 0.0f; // debug report from offset calib
 
     int16_t tim_cnt_sample_ = 0; // 
@@ -103,8 +110,10 @@ public:
             make_protocol_property("count_in_cpr", &count_in_cpr_),
             make_protocol_property("interpolation", &interpolation_),
             make_protocol_ro_property("phase", &phase_),
-            make_protocol_property("pos_estimate", &pos_estimate_),
-            make_protocol_property("pos_cpr", &pos_cpr_),
+            make_protocol_property("pos_estimate", &pos_estimate_,
+                [](void* ctx) { static_cast<Encoder*>(ctx)->load_pos_estimates(); }, this),
+            make_protocol_property("pos_cpr", &pos_cpr_,
+                [](void* ctx) { static_cast<Encoder*>(ctx)->load_pos_estimates(); }, this),
             make_protocol_ro_property("hall_state", &hall_state_),
             make_protocol_property("vel_estimate", &vel_estimate_),
             make_protocol_ro_property("calib_scan_response", &calib_scan_response_),
@@ -119,7 +128,8 @@ public:
                 make_protocol_property("pre_calibrated", &config_.pre_calibrated,
                     [](void* ctx) { static_cast<Encoder*>(ctx)->check_pre_calibrated(); }, this),
                 make_protocol_property("zero_count_on_find_idx", &config_.zero_count_on_find_idx),
-                make_protocol_property("cpr", &config_.cpr),
+                make_protocol_property("cpr", &config_.cpr,
+                    [](void* ctx) { static_cast<Encoder*>(ctx)->invalidate_derived_params(); }, this),
                 make_protocol_property("offset", &config_.offset),
                 make_protocol_property("offset_float", &config_.offset_float),
                 make_protocol_property("enable_phase_interpolation", &config_.enable_phase_interpolation),
@@ -0,0 +1,72 @@
+#ifndef __ENCODER_PLL_HPP
+#define __ENCODER_PLL_HPP
+
+// Count tracking PLL of the encoder (see Encoder::update).
+//
+// The position estimates are kept as an integer count plus a fraction. A
+// float count has no fractional bits left beyond 2^24 counts, this
+// representation keeps the same resolution over any number of revolutions.
+// The integer part wraps around like the encoder count itself.
+//
+// Changes should be checked with odrive_kernel_bench (see Simulator/).
+
+#include <stdint.h>
+#include <math.h>
+#include <math_kernels.hpp>
+
+// @brief Position in encoder counts: counts + frac, frac in [0, 1)
+struct CountPos_t {
+    int32_t counts;  // [count]
+    float frac;      // [count]
+};
+
+// @brief Adds delta to a position and carries the whole counts of the
+// result into the integer part.
+constexpr CountPos_t count_pos_add(CountPos_t pos, float delta) {
+    float x = pos.frac + delta;
+    int32_t n = floor_to_int(x);
+    float frac = x - (float)n;
+    if (frac >= 1.0f) { // x slightly below an integer rounds up
+        frac -= 1.0f;
+        ++n;
+    }
+    return { (int32_t)((uint32_t)pos.counts + (uint32_t)n), frac };
+}
+
+constexpr CountPos_t count_pos_from_float(float x) {
+    return count_pos_add({ 0, 0.0f }, x);
+}
+
+constexpr float count_pos_to_float(CountPos_t pos) {
+    return (float)pos.counts + pos.frac;
+}
+
+// @brief Runs one step of the encoder PLL.
+// @param pos: linear position estimate, tracks count [count]
+// @param pos_cpr: circular position estimate, tracks count_in_cpr [count]
+// @param vel: velocity estimate [count/s]
+// @param dt: time since the last update [s]
+// @returns true if the velocity estimate was snapped to zero
+inline bool encoder_pll_update(CountPos_t& pos, CountPos_t& pos_cpr, float& vel,
+                               int32_t count, int32_t count_in_cpr, int32_t cpr,
+                               float dt, float kp, float ki) {
+    // Predict current pos
+    pos     = count_pos_add(pos, dt * vel);
+    pos_cpr = count_pos_add(pos_cpr, dt * vel);
+    // discrete phase detector: the integer parts are the floor of the
+    // estimates, so the differences are exact
+    int32_t delta_pos     = (int32_t)((uint32_t)count - (uint32_t)pos.counts);
+    int32_t delta_pos_cpr = mod(count_in_cpr - pos_cpr.counts + cpr / 2, cpr) - cpr / 2;
+    // pll feedback
+    pos     = count_pos_add(pos, dt * kp * (float)delta_pos);
+    pos_cpr = count_pos_add(pos_cpr, dt * kp * (float)delta_pos_cpr);
+    pos_cpr.counts = mod(pos_cpr.counts, cpr);
+    vel += dt * ki * (float)delta_pos_cpr;
+    if (fabsf(vel) < 0.5f * dt * ki) {
+        vel = 0.0f; //align delta-sigma on zero to prevent jitter
+        return true;
+    }
+    return false;
+}
+
+#endif // __ENCODER_PLL_HPP
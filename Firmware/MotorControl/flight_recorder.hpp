@@ -0,0 +1,119 @@
+#ifndef __FLIGHT_RECORDER_HPP
+#define __FLIGHT_RECORDER_HPP
+
+#ifndef __ODRIVE_MAIN_H
+#error "This file should not be included directly. Include odrive_main.h instead."
+#endif
+
+// @brief Ring buffer of the last control loop iterations of one axis.
+//
+// The control loop records one entry per iteration. The recorder freezes on
+// the first entry that carries an axis or motor error, so after e.g. a
+// missed control deadline the buffer holds the iterations leading up to it.
+// Call reset() to clear and re-arm it.
+class FlightRecorder {
+public:
+    static constexpr size_t num_entries = 32;
+
+    struct Entry_t {
+        uint32_t loop_counter;
+        uint16_t axis_error;
+        uint16_t motor_error;
+        uint16_t timing_adc_cb_i;     // [clocks] motor timing log stamps
+        uint16_t timing_foc_current;  // [clocks]
+        uint16_t timing_current_cmd;  // [clocks]
+        uint8_t current_state;
+        float vbus_voltage;  // [V]
+        float mod_alpha;     // applied modulation, including the dead time compensation
+        float mod_beta;
+        float Id_setpoint;   // [A]
+        float Iq_setpoint;   // [A]
+        float vel_setpoint;  // [counts/s]
+        float pos_setpoint;  // [counts]
+    };
+
+    // Fields that can be read with get_val(). Keep in sync with
+    // dump_flight_recorder() in tools/odrive/utils.py.
+    enum Field_t {
+        FIELD_AXIS_ERROR,
+        FIELD_MOTOR_ERROR,
+        FIELD_TIMING_ADC_CB_I,
+        FIELD_TIMING_FOC_CURRENT,
+        FIELD_TIMING_CURRENT_CMD,
+        FIELD_CURRENT_STATE,
+        FIELD_VBUS_VOLTAGE,
+        FIELD_MOD_ALPHA,
+        FIELD_MOD_BETA,
+        FIELD_ID_SETPOINT,
+        FIELD_IQ_SETPOINT,
+        FIELD_VEL_SETPOINT,
+        FIELD_POS_SETPOINT,
+    };
+
+    void record(const Entry_t& entry) {
+        if (frozen_)
+            return;
+        entries_[pos_] = entry;
+        pos_ = (pos_ + 1) % num_entries;
+        if (count_ < num_entries)
+            ++count_;
+        if (entry.axis_error || entry.motor_error)
+            frozen_ = true;
+    }
+
+    void reset() {
+        uint32_t mask = cpu_enter_critical();
+        pos_ = 0;
+        count_ = 0;
+        frozen_ = false;
+        cpu_exit_critical(mask);
+    }
+
+    // @brief Returns the entry at the given index, 0 being the oldest one.
+    const Entry_t& get_entry(uint32_t index) {
+        if (index >= count_)
+            index = count_ ? count_ - 1 : 0;
+        return entries_[(pos_ + num_entries - count_ + index) % num_entries];
+    }
+
+    uint32_t get_loop_counter(uint32_t index) {
+        return get_entry(index).loop_counter;
+    }
+
+    float get_val(uint32_t index, uint32_t field) {
+        const Entry_t& entry = get_entry(index);
+        switch (field) {
+            case FIELD_AXIS_ERROR: return entry.axis_error;
+            case FIELD_MOTOR_ERROR: return entry.motor_error;
+            case FIELD_TIMING_ADC_CB_I: return entry.timing_adc_cb_i;
+            case FIELD_TIMING_FOC_CURRENT: return entry.timing_foc_current;
+            case FIELD_TIMING_CURRENT_CMD: return entry.timing_current_cmd;
+            case FIELD_CURRENT_STATE: return entry.current_state;
+            case FIELD_VBUS_VOLTAGE: return entry.vbus_voltage;
+            case FIELD_MOD_ALPHA: return entry.mod_alpha;
+            case FIELD_MOD_BETA: return entry.mod_beta;
+            case FIELD_ID_SETPOINT: return entry.Id_setpoint;
+            case FIELD_IQ_SETPOINT: return entry.Iq_setpoint;
+            case FIELD_VEL_SETPOINT: return entry.vel_setpoint;
+            case FIELD_POS_SETPOINT: return entry.pos_setpoint;
+            default: return 0.0f;
+        }
+    }
+
+    Entry_t entries_[num_entries] = {};
+    uint32_t pos_ = 0;
+    uint32_t count_ = 0;
+    bool frozen_ = false;
+
+    auto make_protocol_definitions() {
+        return make_protocol_member_list(
+            make_protocol_ro_property("frozen", &frozen_),
+            make_protocol_ro_property("count", &count_),
+            make_protocol_function("reset", *this, &FlightRecorder::reset),
+            make_protocol_function("get_loop_counter", *this, &FlightRecorder::get_loop_counter, "index"),
+            make_protocol_function("get_val", *this, &FlightRecorder::get_val, "index", "field")
+        );
+    }
+};
+
+#endif // __FLIGHT_RECORDER_HPP
@@ -35,14 +35,62 @@ const float adc_ref_voltage = 3.3f;
 // This value is updated by the DC-bus reading ADC.
 // Arbitrary non-zero inital value to avoid division by zero if ADC reading is late
 float vbus_voltage = 12.0f;
+float vbus_V_to_mod = 1.5f / 12.0f; // [1/V] modulation per volt, 1 / ((2/3) * vbus_voltage)
 bool brake_resistor_armed = false;
+
+// Updated from board_config by configure_pwm()
+float pwm_frequency = (float)TIM_1_8_CLOCK_HZ / (float)(2 * TIM_1_8_PERIOD_CLOCKS); // [Hz]
+uint16_t tim_1_8_period_clocks = TIM_1_8_PERIOD_CLOCKS;
+uint8_t tim_1_8_rcr = TIM_1_8_RCR;
+float current_meas_period = CURRENT_MEAS_PERIOD;
+int current_meas_hz = CURRENT_MEAS_HZ;
 /* Private constant data -----------------------------------------------------*/
-static const GPIO_TypeDef* GPIOs_to_samp[] = { GPIOA, GPIOB, GPIOC };
-static const int num_GPIO = sizeof(GPIOs_to_samp) / sizeof(GPIOs_to_samp[0]); 
+// Time that the current measurement interrupts and the control loop of M0
+// are given between the M0 current measurement and the point where its
+// new timings are applied. Higher PWM frequencies are rejected.
+static const float min_control_deadline = 30e-6f; // [s]
+// Number of GPIO ports sampled per axis. The hall inputs of each axis are
+// spread over at most two ports (e.g. GPIOB and GPIOA for M0 on v3.1-v3.4,
+// GPIOB and GPIOC on v3.5+), see start_update_event_dma().
+static const int num_GPIO = 2;
+
+// DMA requests of TIM1 (M0) and TIM8 (M1) that fire on the update event,
+// and the DMA2 streams they are mapped to (RM0090 table 43).
+// With CR2.CCDS set, the CCx DMA requests are issued on the update event as
+// well, which gives each timer one request per register to sample.
+struct UpdateEventDma_t {
+    DMA_Stream_TypeDef* stream;
+    uint32_t channel;
+    uint32_t tim_dma_request;
+};
+static const UpdateEventDma_t update_event_dma[2][1 + num_GPIO] = {
+    { { DMA2_Stream5, DMA_CHANNEL_6, TIM_DMA_UPDATE },   // TIM1_UP: encoder counter
+      { DMA2_Stream3, DMA_CHANNEL_6, TIM_DMA_CC1 },      // TIM1_CH1: first hall port
+      { DMA2_Stream6, DMA_CHANNEL_6, TIM_DMA_CC3 } },    // TIM1_CH3: second hall port
+    { { DMA2_Stream1, DMA_CHANNEL_7, TIM_DMA_UPDATE },   // TIM8_UP: encoder counter
+      { DMA2_Stream4, DMA_CHANNEL_7, TIM_DMA_CC3 },      // TIM8_CH3: first hall port
+      { DMA2_Stream7, DMA_CHANNEL_7, TIM_DMA_CC4 } },    // TIM8_CH4: second hall port
+};
 /* Private variables ---------------------------------------------------------*/
 
-// Two motors, sampling port A,B,C (coherent with current meas timing)
-static uint16_t GPIO_port_samples [2][num_GPIO];
+// Two motors, sampling the encoder counter and the hall ports (coherent with current meas timing).
+// Written by DMA on every update event of the PWM timer of the axis.
+static volatile uint16_t enc_cnt_samples[2];
+static volatile uint16_t GPIO_port_samples[2][num_GPIO];
+static GPIO_TypeDef* GPIOs_to_samp[2][num_GPIO];
+static DMA_HandleTypeDef hdma_update_event[2][1 + num_GPIO];
+
+// Location of each hall input of each axis in GPIO_port_samples.
+// Index 0 is HallA, 1 is HallB and 2 is HallC.
+struct HallSampleMap_t {
+    uint8_t port_idx;
+    uint16_t pin;
+};
+static HallSampleMap_t hall_sample_map[2][3];
+
+// Filter constant of the current sense offset calibration
+#define calib_tau 0.2f  //@TOTO make more easily configurable
+static float calib_filter_k = CURRENT_MEAS_PERIOD / calib_tau;
 /* CPU critical section helpers ----------------------------------------------*/
 
 /* Safety critical functions -------------------------------------------------*/
@@ -108,11 +156,13 @@ void safety_critical_arm_motor_pwm(Motor& motor) {
 // motor phases are floating and will not be enabled again until
 // safety_critical_arm_motor_phases is called.
 // @returns true if the motor was in a state other than disarmed before
-bool safety_critical_disarm_motor_pwm(Motor& motor) {
+__RAM_FUNC bool safety_critical_disarm_motor_pwm(Motor& motor) {
     uint32_t mask = cpu_enter_critical();
     bool was_armed = motor.armed_state_ != Motor::ARMED_STATE_DISARMED;
     motor.armed_state_ = Motor::ARMED_STATE_DISARMED;
     __HAL_TIM_MOE_DISABLE_UNCONDITIONALLY(motor.hw_config_.timer);
+    // With the outputs off, no phase is clamped anymore
+    motor.clamped_phases_ = 0;
     cpu_exit_critical(mask);
     return was_armed;
 }
@@ -122,7 +172,7 @@ bool safety_critical_disarm_motor_pwm(Motor& motor) {
 // If this is called at a rate higher than the motor's timer period,
 // the actual PMW timings on the pins can be undefined for up to one
 // timer period.
-void safety_critical_apply_motor_pwm_timings(Motor& motor, uint16_t timings[3]) {
+__RAM_FUNC void safety_critical_apply_motor_pwm_timings(Motor& motor, uint16_t timings[3]) {
     uint32_t mask = cpu_enter_critical();
     if (!brake_resistor_armed) {
         motor.armed_state_ = Motor::ARMED_STATE_DISARMED;
@@ -132,6 +182,16 @@ void safety_critical_apply_motor_pwm_timings(Motor& motor, uint16_t timings[3])
     motor.hw_config_.timer->Instance->CCR2 = timings[1];
     motor.hw_config_.timer->Instance->CCR3 = timings[2];
 
+    // Keep track of clamped phases for the DC calibration. The previous
+    // timings are included because the new ones only take effect at the
+    // next update event.
+    uint8_t clamped_phases = 0;
+    for (size_t i = 0; i < 3; ++i) {
+        if (timings[i] >= tim_1_8_period_clocks)
+            clamped_phases |= 1 << i;
+    }
+    motor.clamped_phases_ = (motor.clamped_phases_ << 4) | clamped_phases;
+
     if (motor.armed_state_ == Motor::ARMED_STATE_WAITING_FOR_TIMINGS) {
         // timings were just loaded into the timer registers
         // the timer register are buffered, so they won't have an effect
@@ -178,7 +238,7 @@ void safety_critical_disarm_brake_resistor() {
 
 // @brief Updates the brake resistor PWM timings unless
 // the brake resistor is disarmed.
-void safety_critical_apply_brake_resistor_timings(uint32_t low_off, uint32_t high_on) {
+__RAM_FUNC void safety_critical_apply_brake_resistor_timings(uint32_t low_off, uint32_t high_on) {
     if (high_on - low_off < TIM_APB1_DEADTIME_CLOCKS)
         low_level_fault(Motor::ERROR_BRAKE_DEADTIME_VIOLATION);
     uint32_t mask = cpu_enter_critical();
@@ -196,6 +256,59 @@ void safety_critical_apply_brake_resistor_timings(uint32_t low_off, uint32_t hig
 
 /* Function implementations --------------------------------------------------*/
 
+// @brief Sets up the PWM timing of both motors and recomputes all values derived from it.
+//
+// The requested frequency is rounded to the timer resolution. It must keep
+// the timing log within 16 bits and leave at least min_control_deadline
+// between the M0 current measurement and the update of its timings.
+// Otherwise the default frequency is used.
+//
+// By default the current is measured every third PWM period. If
+// current_meas_every_period is set, the timers generate an update event at
+// every counter extreme instead. The current is then measured and the
+// timings are updated in every PWM period. The DC calibration still uses the
+// samples at the top of the counter. Those are taken while the low-side
+// shunts carry no current, so the current can't be sampled twice per period.
+//
+// Must be called before the axis objects are constructed and before start_adc_pwm().
+// @returns: True if the requested frequency was applied, false otherwise
+bool configure_pwm(float requested_frequency, bool current_meas_every_period) {
+    static const float min_deadline_clocks = min_control_deadline * (float)TIM_1_8_CLOCK_HZ;
+
+    // The repetition counter must be even, so that update events alternate
+    // between the top and the bottom of the counter
+    tim_1_8_rcr = current_meas_every_period ? 0 : TIM_1_8_RCR;
+
+    // The timing log spans one current measurement period, i.e. 2 * (tim_1_8_rcr+1) timer periods
+    float max_period_clocks = (float)(UINT16_MAX / (2 * (tim_1_8_rcr + 1)));
+    float period_clocks = roundf((float)TIM_1_8_CLOCK_HZ / (2.0f * requested_frequency));
+    // The M0 timings are applied on the TIM8 update event that follows the
+    // M0 current measurement, half a period plus the sync offset later (see start_adc_pwm)
+    float deadline_clocks = (float)(tim_1_8_rcr + 1) * period_clocks + (period_clocks / 2.0f - 128.0f);
+    bool valid = (period_clocks <= max_period_clocks) && (deadline_clocks >= min_deadline_clocks);
+    if (!valid)
+        period_clocks = (float)TIM_1_8_PERIOD_CLOCKS;
+
+    tim_1_8_period_clocks = (uint16_t)period_clocks;
+    pwm_frequency = (float)TIM_1_8_CLOCK_HZ / (2.0f * period_clocks);
+    current_meas_period = (float)(2 * (tim_1_8_rcr + 1)) * period_clocks / (float)TIM_1_8_CLOCK_HZ;
+    current_meas_hz = (int)roundf(1.0f / current_meas_period);
+    calib_filter_k = current_meas_period / calib_tau;
+
+    for (TIM_HandleTypeDef* htim : { &htim1, &htim8 }) {
+        __HAL_TIM_SET_AUTORELOAD(htim, tim_1_8_period_clocks);
+        htim->Init.RepetitionCounter = tim_1_8_rcr;
+        htim->Instance->RCR = tim_1_8_rcr;
+        // Load the repetition counter now rather than at the first update event
+        htim->Instance->EGR = TIM_EGR_UG;
+        __HAL_TIM_CLEAR_FLAG(htim, TIM_FLAG_UPDATE);
+    }
+    // TIM13 wraps once per current measurement period
+    __HAL_TIM_SET_AUTORELOAD(&htim13, (2 * tim_1_8_period_clocks * (tim_1_8_rcr + 1))
+            * ((float)TIM_APB1_CLOCK_HZ / (float)TIM_1_8_CLOCK_HZ) - 1);
+    return valid;
+}
+
 void start_adc_pwm() {
     // Enable ADC and interrupts
     __HAL_ADC_ENABLE(&hadc1);
@@ -204,9 +317,9 @@ void start_adc_pwm() {
     // Warp field stabilize.
     osDelay(2);
     __HAL_ADC_ENABLE_IT(&hadc1, ADC_IT_JEOC);
-    __HAL_ADC_ENABLE_IT(&hadc2, ADC_IT_JEOC);
+    // ADC2 and ADC3 are started by the same trigger and convert in lockstep,
+    // so only ADC3 raises an interrupt. pwm_trig_adc_cb reads both phases.
     __HAL_ADC_ENABLE_IT(&hadc3, ADC_IT_JEOC);
-    __HAL_ADC_ENABLE_IT(&hadc2, ADC_IT_EOC);
     __HAL_ADC_ENABLE_IT(&hadc3, ADC_IT_EOC);
 
     // Ensure that debug halting of the core doesn't leave the motor PWM running
@@ -216,16 +329,15 @@ void start_adc_pwm() {
     start_pwm(&htim1);
     start_pwm(&htim8);
     // TODO: explain why this offset
-    sync_timers(&htim1, &htim8, TIM_CLOCKSOURCE_ITR0, TIM_1_8_PERIOD_CLOCKS / 2 - 1 * 128,
+    sync_timers(&htim1, &htim8, TIM_CLOCKSOURCE_ITR0, tim_1_8_period_clocks / 2 - 1 * 128,
             &htim13);
 
     // Motor output starts in the disabled state
     __HAL_TIM_MOE_DISABLE_UNCONDITIONALLY(&htim1);
     __HAL_TIM_MOE_DISABLE_UNCONDITIONALLY(&htim8);
 
-    // Enable the update interrupt (used to coherently sample GPIO)
-    __HAL_TIM_ENABLE_IT(&htim1, TIM_IT_UPDATE);
-    __HAL_TIM_ENABLE_IT(&htim8, TIM_IT_UPDATE);
+    // Sample the encoders and GPIOs coherently with the current measurements
+    start_update_event_dma();
 
     // Start brake resistor PWM in floating output configuration
     htim2.Instance->CCR3 = 0;
@@ -240,9 +352,76 @@ void start_adc_pwm() {
     safety_critical_arm_brake_resistor();
 }
 
+// @brief Sets up the DMA transfers that capture the encoder counter and the
+// hall sensor GPIO ports of each axis on the update event of its PWM timer.
+// The samples are picked up in pwm_trig_adc_cb, so no interrupt is needed.
+void start_update_event_dma() {
+    TIM_HandleTypeDef* pwm_timers[2] = { &htim1, &htim8 };
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        // Sample the ports that hold the hall inputs of this axis. Both
+        // entries are set, so if all inputs are on one port it is sampled twice.
+        const EncoderHardwareConfig_t& enc_hw = hw_configs[i].encoder_config;
+        GPIO_TypeDef* hall_ports[3] = { enc_hw.hallA_port, enc_hw.hallB_port, enc_hw.hallC_port };
+        const uint16_t hall_pins[3] = { enc_hw.hallA_pin, enc_hw.hallB_pin, enc_hw.hallC_pin };
+        int num_ports = 0;
+        for (int j = 0; j < 3; ++j) {
+            bool known = false;
+            for (int k = 0; k < num_ports; ++k)
+                known = known || (GPIOs_to_samp[i][k] == hall_ports[j]);
+            if (!known && num_ports < num_GPIO)
+                GPIOs_to_samp[i][num_ports++] = hall_ports[j];
+        }
+        for (int k = num_ports; k < num_GPIO; ++k)
+            GPIOs_to_samp[i][k] = GPIOs_to_samp[i][0];
+
+        volatile uint32_t* src[1 + num_GPIO] = { &enc_hw.timer->Instance->CNT };
+        volatile uint16_t* dst[1 + num_GPIO] = { &enc_cnt_samples[i] };
+        for (int j = 0; j < num_GPIO; ++j) {
+            src[1 + j] = &GPIOs_to_samp[i][j]->IDR;
+            dst[1 + j] = &GPIO_port_samples[i][j];
+        }
+
+        uint32_t tim_dma_requests = 0;
+        for (int j = 0; j < 1 + num_GPIO; ++j) {
+            DMA_HandleTypeDef* hdma = &hdma_update_event[i][j];
+            hdma->Instance = update_event_dma[i][j].stream;
+            hdma->Init.Channel = update_event_dma[i][j].channel;
+            hdma->Init.Direction = DMA_PERIPH_TO_MEMORY;
+            hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+            hdma->Init.MemInc = DMA_MINC_DISABLE;
+            hdma->Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+            hdma->Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+            hdma->Init.Mode = DMA_CIRCULAR;
+            hdma->Init.Priority = DMA_PRIORITY_VERY_HIGH;
+            hdma->Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+            if (HAL_DMA_Init(hdma) != HAL_OK
+                    || HAL_DMA_Start(hdma, (uintptr_t)src[j], (uintptr_t)dst[j], 1) != HAL_OK) {
+                low_level_fault(Motor::ERROR_ADC_FAILED);
+                return;
+            }
+            tim_dma_requests |= update_event_dma[i][j].tim_dma_request;
+        }
+
+        pwm_timers[i]->Instance->CR2 |= TIM_CR2_CCDS;
+        __HAL_TIM_ENABLE_DMA(pwm_timers[i], tim_dma_requests);
+
+        // Resolve where the hall inputs end up in the samples, so that the
+        // ISR doesn't have to search for them. A hall input on a port that
+        // isn't sampled (only if the inputs span more than num_GPIO ports)
+        // reads as 0, which results in an illegal hall state.
+        for (int j = 0; j < 3; ++j) {
+            hall_sample_map[i][j] = { 0, 0 };
+            for (int k = 0; k < num_GPIO; ++k) {
+                if (GPIOs_to_samp[i][k] == hall_ports[j])
+                    hall_sample_map[i][j] = { (uint8_t)k, hall_pins[j] };
+            }
+        }
+    }
+}
+
 void start_pwm(TIM_HandleTypeDef* htim) {
     // Init PWM
-    int half_load = TIM_1_8_PERIOD_CLOCKS / 2;
+    int half_load = tim_1_8_period_clocks / 2;
     htim->Instance->CCR1 = half_load;
     htim->Instance->CCR2 = half_load;
     htim->Instance->CCR3 = half_load;
@@ -421,11 +600,14 @@ float get_adc_voltage(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin) {
 // IRQ Callbacks
 //--------------------------------
 
-void vbus_sense_adc_cb(ADC_HandleTypeDef* hadc, bool injected) {
+__RAM_FUNC void vbus_sense_adc_cb(ADC_HandleTypeDef* hadc, bool injected) {
     static const float voltage_scale = adc_ref_voltage * VBUS_S_DIVIDER_RATIO / adc_full_scale;
-    // Only one conversion in sequence, so only rank1
-    uint32_t ADCValue = HAL_ADCEx_InjectedGetValue(hadc, ADC_INJECTED_RANK_1);
+    // Only one conversion in sequence, so only rank1. The data register is
+    // read directly, the HAL getter is not placed in RAM.
+    uint32_t ADCValue = hadc->Instance->JDR1;
     vbus_voltage = ADCValue * voltage_scale;
+    // Shared by all users of the modulation scale, see Motor::FOC_current
+    vbus_V_to_mod = vbus_voltage > 0.0f ? 1.5f / vbus_voltage : 0.0f;
     if (axes[0] && !axes[0]->error_ && axes[1] && !axes[1]->error_) {
         if (oscilloscope_pos >= OSCILLOSCOPE_SIZE)
             oscilloscope_pos = 0;
@@ -433,47 +615,48 @@ void vbus_sense_adc_cb(ADC_HandleTypeDef* hadc, bool injected) {
     }
 }
 
-static void decode_hall_samples(Encoder& enc, uint16_t GPIO_samples[num_GPIO]) {
-    GPIO_TypeDef* hall_ports[] = {
-        enc.hw_config_.hallC_port,
-        enc.hw_config_.hallB_port,
-        enc.hw_config_.hallA_port,
-    };
-    uint16_t hall_pins[] = {
-        enc.hw_config_.hallC_pin,
-        enc.hw_config_.hallB_pin,
-        enc.hw_config_.hallA_pin,
-    };
-
-    uint8_t hall_state = 0x0;
-    for (int i = 0; i < 3; ++i) {
-        int port_idx = 0;
-        for (;;) {
-            auto port = GPIOs_to_samp[port_idx];
-            if (port == hall_ports[i])
-                break;
-            ++port_idx;
-        }
-
-        hall_state <<= 1;
-        hall_state |= (GPIO_samples[port_idx] & hall_pins[i]) ? 1 : 0;
-    }
-
-    enc.hall_state_ = hall_state;
+__RAM_FUNC static void decode_hall_samples(Encoder& enc, int axis_num) {
+    const HallSampleMap_t* map = hall_sample_map[axis_num];
+    volatile uint16_t* GPIO_samples = GPIO_port_samples[axis_num];
+    enc.hall_state_ = ((GPIO_samples[map[0].port_idx] & map[0].pin) ? 0b001 : 0)
+                    | ((GPIO_samples[map[1].port_idx] & map[1].pin) ? 0b010 : 0)
+                    | ((GPIO_samples[map[2].port_idx] & map[2].pin) ? 0b100 : 0);
 }
 
 // This is the callback from the ADC that we expect after the PWM has triggered an ADC conversion.
 // TODO: Document how the phasing is done, link to timing diagram
-void pwm_trig_adc_cb(ADC_HandleTypeDef* hadc, bool injected) {
-#define calib_tau 0.2f  //@TOTO make more easily configurable
-    static const float calib_filter_k = CURRENT_MEAS_PERIOD / calib_tau;
+//
+// ADC2 (phB) and ADC3 (phC) are started by the same trigger with the same
+// sample time and clock, so they finish on the same cycle. Only ADC3 raises
+// an interrupt; the phB sample is read from the ADC2 data register here.
+// The end of conversion flag of ADC2 is checked rather than assumed.
+__RAM_FUNC void pwm_trig_adc_cb(ADC_HandleTypeDef* hadc, bool injected) {
+    uint32_t entry_cycles = cycles_now();
 
     // Ensure ADCs are expected ones to simplify the logic below
-    if (!(hadc == &hadc2 || hadc == &hadc3)) {
+    if (hadc != &hadc3) {
         low_level_fault(Motor::ERROR_ADC_FAILED);
         return;
     };
 
+    // Fetch the phB sample of the same trigger event from ADC2
+    uint32_t eoc_flag = injected ? ADC_FLAG_JEOC : ADC_FLAG_EOC;
+    if (!__HAL_ADC_GET_FLAG(&hadc2, eoc_flag)) {
+        low_level_fault(Motor::ERROR_ADC_FAILED);
+        return;
+    }
+    // The data registers are read directly, the HAL getters are not placed in RAM
+    uint32_t ADCValue_phB, ADCValue_phC;
+    if (injected) {
+        ADCValue_phB = hadc2.Instance->JDR1;
+        ADCValue_phC = hadc->Instance->JDR1;
+        __HAL_ADC_CLEAR_FLAG(&hadc2, (ADC_FLAG_JSTRT | ADC_FLAG_JEOC));
+    } else {
+        ADCValue_phB = hadc2.Instance->DR;
+        ADCValue_phC = hadc->Instance->DR;
+        __HAL_ADC_CLEAR_FLAG(&hadc2, (ADC_FLAG_STRT | ADC_FLAG_EOC));
+    }
+
     // Motor 0 is on Timer 1, which triggers ADC 2 and 3 on an injected conversion
     // Motor 1 is on Timer 8, which triggers ADC 2 and 3 on a regular conversion
     // If the corresponding timer is counting up, we just sampled in SVM vector 0, i.e. real current
@@ -485,18 +668,17 @@ void pwm_trig_adc_cb(ADC_HandleTypeDef* hadc, bool injected) {
     bool current_meas_not_DC_CAL = !counting_down;
 
     // Check the timing of the sequencing
-    if (current_meas_not_DC_CAL)
+    if (current_meas_not_DC_CAL) {
         axis.motor_.log_timing(Motor::TIMING_LOG_ADC_CB_I);
-    else
+        axis.profiler_.record_from_isr(Profiler::SLOT_ISR_ENTRY, timing_cycles_now());
+    } else
         axis.motor_.log_timing(Motor::TIMING_LOG_ADC_CB_DC);
 
     bool update_timings = false;
-    if (hadc == &hadc2) {
-        if (&axis == axes[1] && counting_down)
-            update_timings = true; // update timings of M0
-        else if (&axis == axes[0] && !counting_down)
-            update_timings = true; // update timings of M1
-    }
+    if (&axis == axes[1] && counting_down)
+        update_timings = true; // update timings of M0
+    else if (&axis == axes[0] && !counting_down)
+        update_timings = true; // update timings of M1
 
     // Load next timings for the motor that we're not currently sampling
     if (update_timings) {
@@ -516,74 +698,39 @@ void pwm_trig_adc_cb(ADC_HandleTypeDef* hadc, bool injected) {
         update_brake_current();
     }
 
-    uint32_t ADCValue;
-    if (injected) {
-        ADCValue = HAL_ADCEx_InjectedGetValue(hadc, ADC_INJECTED_RANK_1);
-    } else {
-        ADCValue = HAL_ADC_GetValue(hadc);
-    }
-    float current = axis.motor_.phase_current_from_adcval(ADCValue);
+    float current_phB = axis.motor_.phase_current_from_adcval(ADCValue_phB);
+    float current_phC = axis.motor_.phase_current_from_adcval(ADCValue_phC);
 
     if (current_meas_not_DC_CAL) {
-        // ADC2 and ADC3 record the phB and phC currents concurrently,
-        // and their interrupts should arrive on the same clock cycle.
-        // We dispatch the callbacks in order, so ADC2 will always be processed before ADC3.
-        // Therefore we store the value from ADC2 and signal the thread that the
-        // measurement is ready when we receive the ADC3 measurement
-
-        // return or continue
-        if (hadc == &hadc2) {
-            axis.motor_.current_meas_.phB = current - axis.motor_.DC_calib_.phB;
-            return;
-        } else {
-            axis.motor_.current_meas_.phC = current - axis.motor_.DC_calib_.phC;
-        }
-        // Prepare hall readings
+        axis.motor_.current_meas_.phB = current_phB - axis.motor_.DC_calib_.phB;
+        axis.motor_.current_meas_.phC = current_phC - axis.motor_.DC_calib_.phC;
+        // Pick up the encoder and hall readings that DMA captured at the
+        // update event. The next update event is at least half a PWM
+        // period away, so the samples can't be overwritten while we read them.
         // TODO move this to inside encoder update function
-        decode_hall_samples(axis.encoder_, GPIO_port_samples[axis_num]);
+        axis.encoder_.sample_now(enc_cnt_samples[axis_num]);
+        decode_hall_samples(axis.encoder_, axis_num);
+        // Run the current controller if it lives in the interrupt
+        axis.motor_.current_meas_cb();
         // Trigger axis thread
+        axis.profiler_.current_meas_done();
         axis.signal_current_meas();
+        axis.profiler_.record_from_isr(Profiler::SLOT_CURRENT_MEAS_CB, cycles_now() - entry_cycles);
     } else {
         // DC_CAL measurement
-        if (hadc == &hadc2) {
-            axis.motor_.DC_calib_.phB += (current - axis.motor_.DC_calib_.phB) * calib_filter_k;
-        } else {
-            axis.motor_.DC_calib_.phC += (current - axis.motor_.DC_calib_.phC) * calib_filter_k;
-        }
-    }
-}
-
-void tim_update_cb(TIM_HandleTypeDef* htim) {
-    
-    // If the corresponding timer is counting up, we just sampled in SVM vector 0, i.e. real current
-    // If we are counting down, we just sampled in SVM vector 7, with zero current
-    bool counting_down = htim->Instance->CR1 & TIM_CR1_DIR;
-    if (counting_down)
-        return;
-    
-    int sample_ch;
-    Axis* axis;
-    if (htim == &htim1) {
-        sample_ch = 0;
-        axis = axes[0];
-    } else if (htim == &htim8) {
-        sample_ch = 1;
-        axis = axes[1];
-    } else {
-        low_level_fault(Motor::ERROR_UNEXPECTED_TIMER_CALLBACK);
-        return;
-    }
-
-    axis->encoder_.sample_now();
-
-    for (int i = 0; i < num_GPIO; ++i) {
-        GPIO_port_samples[sample_ch][i] = GPIOs_to_samp[i]->IDR;
+        // Phases that are clamped to DC- (see MODULATION_TYPE_DPWM_MIN) carry
+        // current at the top of the counter and are skipped.
+        uint8_t clamped_phases = axis.motor_.clamped_phases_ | (axis.motor_.clamped_phases_ >> 4);
+        if (!(clamped_phases & 0b010))
+            axis.motor_.DC_calib_.phB += (current_phB - axis.motor_.DC_calib_.phB) * calib_filter_k;
+        if (!(clamped_phases & 0b100))
+            axis.motor_.DC_calib_.phC += (current_phC - axis.motor_.DC_calib_.phC) * calib_filter_k;
     }
 }
 
 // @brief Sums up the Ibus contribution of each motor and updates the
 // brake resistor PWM accordingly.
-void update_brake_current() {
+__RAM_FUNC void update_brake_current() {
     float Ibus_sum = 0.0f;
     for (size_t i = 0; i < AXIS_COUNT; ++i) {
         if (axes[i]->motor_.armed_state_ == Motor::ARMED_STATE_ARMED) {
@@ -608,6 +755,27 @@ void update_brake_current() {
     }
 }
 
+// @brief Starts the DWT cycle counter used by the profiler (see cycles_now())
+void profiler_init() {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+// @brief Returns the time since the start of the current control period
+// in TIM_1_8 clock cycles. TIM13 wraps once per current measurement period.
+__RAM_FUNC uint16_t timing_clocks_now() {
+    static const uint16_t clocks_per_cnt = (uint16_t)((float)TIM_1_8_CLOCK_HZ / (float)TIM_APB1_CLOCK_HZ);
+    return clocks_per_cnt * htim13.Instance->CNT; // TODO: Use a hw_config
+}
+
+// @brief Returns the time since the start of the current control period
+// in CPU cycles, with the resolution of TIM13 (2 cycles).
+__RAM_FUNC uint32_t timing_cycles_now() {
+    static const uint32_t cycles_per_cnt = Profiler::cpu_clock_hz / TIM_APB1_CLOCK_HZ;
+    return cycles_per_cnt * htim13.Instance->CNT;
+}
+
 
 /* RC PWM input --------------------------------------------------------------*/
 
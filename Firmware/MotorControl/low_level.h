@@ -22,7 +22,11 @@ extern const float adc_full_scale;
 extern const float adc_ref_voltage;
 /* Exported variables --------------------------------------------------------*/
 extern float vbus_voltage;
+extern float vbus_V_to_mod;
 extern bool brake_resistor_armed;
+extern float pwm_frequency;
+extern uint16_t tim_1_8_period_clocks;
+extern uint8_t tim_1_8_rcr;
 extern uint16_t adc_measurements_[ADC_CHANNEL_COUNT];
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions --------------------------------------------------------*/
@@ -38,12 +42,13 @@ void safety_critical_apply_brake_resistor_timings(uint32_t low_off, uint32_t hig
 extern "C" {
 void pwm_trig_adc_cb(ADC_HandleTypeDef* hadc, bool injected);
 void vbus_sense_adc_cb(ADC_HandleTypeDef* hadc, bool injected);
-void tim_update_cb(TIM_HandleTypeDef* htim);
 void pwm_in_cb(int channel, uint32_t timestamp);
 }
 
 // Initalisation
+bool configure_pwm(float requested_frequency, bool current_meas_every_period);
 void start_adc_pwm();
+void start_update_event_dma();
 void start_pwm(TIM_HandleTypeDef* htim);
 void sync_timers(TIM_HandleTypeDef* htim_a, TIM_HandleTypeDef* htim_b,
                  uint16_t TIM_CLOCKSOURCE_ITRx, uint16_t count_offset,
@@ -54,6 +59,8 @@ void pwm_in_init();
 void start_analog_thread();
 
 void update_brake_current();
+uint16_t timing_clocks_now();
+uint32_t timing_cycles_now();
 
 inline uint32_t cpu_enter_critical() {
     uint32_t primask = __get_PRIMASK();
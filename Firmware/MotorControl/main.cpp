@@ -159,6 +159,10 @@ int odrive_main(void) {
     HAL_GPIO_Init(GPIO_5_GPIO_Port, &GPIO_InitStruct);
 #endif
 
+    // Apply the PWM timing first since the objects below derive values from it.
+    // If the frequency is not supported, the default is used (see odrv.pwm_frequency).
+    configure_pwm(board_config.pwm_frequency, board_config.current_meas_every_pwm_period);
+
     // Construct all objects.
     for (size_t i = 0; i < AXIS_COUNT; ++i) {
         Encoder *encoder = new Encoder(hw_configs[i].encoder_config,
@@ -195,6 +199,9 @@ int odrive_main(void) {
         axes[i]->setup();
     }
 
+    // Start the cycle counter of the profiler
+    profiler_init();
+
     // Start PWM and enable adc interrupts/callbacks
     start_adc_pwm();
 
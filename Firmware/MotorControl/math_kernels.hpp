@@ -0,0 +1,104 @@
+#ifndef __MATH_KERNELS_HPP
+#define __MATH_KERNELS_HPP
+
+// Small math functions used in the control loop.
+//
+// All of them have a bounded cost: the common case is a few instructions
+// without loops, rare inputs take one slower path at most. Except for
+// horner_fma they are constexpr, so they can also be used for constants.
+//
+// Changes should be checked with odrive_kernel_bench (see Simulator/).
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <utils.h>
+
+// @brief Largest integer not greater than x. x must be within the int32 range.
+constexpr int32_t floor_to_int(float x) {
+    int32_t n = (int32_t)x;
+    return ((float)n > x) ? n - 1 : n;
+}
+
+// @brief Wraps x into [min, min + period).
+// Inputs within one period of the range take a single conditional step.
+// Inputs further out are reduced with one division. Beyond 2^23 periods a
+// float can no longer resolve the position within the period, so infinity
+// and such inputs return min. NaN is returned unchanged.
+constexpr float wrap_range(float x, float min, float period) {
+    float max = min + period;
+    if (x >= max)
+        x -= period;
+    else if (x < min)
+        x += period;
+    else
+        return x;
+    if (!(x >= min && x < max)) {
+        float periods = (x - min) / period;
+        if (!(periods > -8388608.0f && periods < 8388608.0f))
+            return min;
+        x -= (float)floor_to_int(periods) * period;
+        if (x >= max)
+            x -= period;
+        else if (x < min)
+            x += period;
+    }
+    return x;
+}
+
+// @brief Wraps x into [-pm_range, pm_range)
+constexpr float wrap_pm(float x, float pm_range) {
+    return wrap_range(x, -pm_range, 2.0f * pm_range);
+}
+
+// @brief Wraps an angle into [-pi, pi)
+constexpr float wrap_pm_pi(float theta) {
+    return wrap_pm(theta, M_PI);
+}
+
+// @brief Like fmodf, but always positive: wraps x into [0, y)
+constexpr float fmodf_pos(float x, float y) {
+    return wrap_range(x, 0.0f, y);
+}
+
+// @brief Modulo (as opposed to remainder), per https://stackoverflow.com/a/19288271
+// divisor must be positive. Power of two divisors (most encoder CPRs) take
+// a mask instead of a division. Otherwise the sign is fixed up without a branch.
+constexpr int mod(int dividend, int divisor) {
+    if ((divisor & (divisor - 1)) == 0)
+        return dividend & (divisor - 1);
+    int r = dividend % divisor;
+    return r + (divisor & -(int)(r < 0));
+}
+
+// @brief atan2 approximation, max error about 2e-4 rad
+// based on https://math.stackexchange.com/a/1105038/81278
+constexpr float fast_atan2(float y, float x) {
+    // a := min (|x|, |y|) / max (|x|, |y|)
+    float abs_y = y < 0.0f ? -y : y;
+    float abs_x = x < 0.0f ? -x : x;
+    // inject FLT_MIN in denominator to avoid division by zero
+    float a = MACRO_MIN(abs_x, abs_y) / (MACRO_MAX(abs_x, abs_y) + 1.17549435e-38f);
+    // s := a * a
+    float s = a * a;
+    // r := ((-0.0464964749 * s + 0.15931422) * s - 0.327622764) * s * a + a
+    float r = ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
+    // if |y| > |x| then r := 1.57079637 - r
+    r = (abs_y > abs_x) ? 1.57079637f - r : r;
+    // if x < 0 then r := 3.14159274 - r
+    r = (x < 0.0f) ? 3.14159274f - r : r;
+    // if y < 0 then r := -r
+    return (y < 0.0f) ? -r : r;
+}
+
+// @brief Evaluates a polynomial using fused multiply add.
+// coeffs[0] is highest order, as per numpy.polyfit
+// p(x) = coeffs[0] * x^deg + ... + coeffs[deg], for some degree "deg"
+inline float horner_fma(float x, const float *coeffs, size_t count) {
+    float result = 0.0f;
+    for (size_t idx = 0; idx < count; ++idx)
+        result = fmaf(result, x, coeffs[idx]);
+    return result;
+}
+
+#endif // __MATH_KERNELS_HPP
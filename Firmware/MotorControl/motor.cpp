@@ -43,6 +43,7 @@ bool Motor::arm() {
     if (!axis_->wait_for_current_meas())
         return axis_->error_ |= Axis::ERROR_CURRENT_MEASUREMENT_TIMEOUT, false;
     next_timings_valid_ = false;
+    current_control_in_isr_ = config_.current_control_in_isr;
     safety_critical_arm_motor_pwm(*this);
     return true;
 }
@@ -50,11 +51,16 @@ bool Motor::arm() {
 void Motor::reset_current_control() {
     current_control_.v_current_control_integral_d = 0.0f;
     current_control_.v_current_control_integral_q = 0.0f;
+    current_control_.Id_field_weakening = 0.0f;
+    // The resistance estimate itself is kept since the motor does not cool
+    // down just because it was disarmed.
+    resistance_estimator_ = {};
+    isr_current_command_pending_ = false;
 }
 
 // @brief Tune the current controller based on phase resistance and inductance
 // This should be invoked whenever one of these values changes.
-// TODO: allow update on user-request or update automatically via hooks
+// Protocol writes reach it through Axis::update_derived_params.
 void Motor::update_current_controller_gains() {
     // Calculate current control gains
     current_control_.p_gain = config_.current_control_bandwidth * config_.phase_inductance;
@@ -62,6 +68,11 @@ void Motor::update_current_controller_gains() {
     current_control_.i_gain = plant_pole * current_control_.p_gain;
 }
 
+void Motor::invalidate_derived_params() {
+    if (axis_)
+        axis_->invalidate_derived_params();
+}
+
 // @brief Set up the gate drivers
 void Motor::DRV8301_setup() {
     // for reference:
@@ -149,11 +160,71 @@ float Motor::get_inverter_temp() {
     return horner_fma(normalized_voltage, thermistor_poly_coeffs, thermistor_num_coeffs);
 }
 
+// @brief Sets the modelled temperatures to config_.ambient_temp.
+// Called at startup, once the configuration is loaded, and when the ambient
+// temperature is written.
+void Motor::reset_thermal_model() {
+    thermal_model_.winding_temp = config_.ambient_temp;
+    thermal_model_.housing_temp = config_.ambient_temp;
+}
+
+// @brief Advances the motor thermal model by the time since the previous call.
+// The copper losses are averaged over all current measurements in that time,
+// so the model can run at a fraction of the control rate. It is integrated
+// with backward Euler, which stays stable for long intervals too (the checks
+// don't run during calibration).
+void Motor::update_motor_thermal_model() {
+    ThermalModel_t& tm = thermal_model_;
+    uint32_t mask = cpu_enter_critical();
+    float I_sqr_sum = tm.I_sqr_sum;
+    uint32_t n_samples = tm.n_samples;
+    tm.I_sqr_sum = 0.0f;
+    tm.n_samples = 0;
+    cpu_exit_critical(mask);
+    if (!config_.thermal_model_enable || n_samples == 0)
+        return;
+    float dt = (float)n_samples * current_meas_period;
+
+    // Resistance at the present winding temperature. The factor 3/2 is there
+    // because the Clarke transform preserves amplitude, not power.
+    float R = config_.phase_resistance * (1.0f + config_.phase_resistance_temp_coeff
+            * (tm.winding_temp - config_.phase_resistance_ref_temp));
+    if (config_.resistance_estimation_enable && phase_resistance_est_ > 0.0f)
+        R = phase_resistance_est_;
+    tm.copper_losses = 1.5f * R * I_sqr_sum / (float)n_samples;
+
+    // Solve for the new temperatures:
+    //   Cw/dt * (Tw' - Tw) = P - (Tw' - Th') / Rw
+    //   Ch/dt * (Th' - Th) = (Tw' - Th') / Rw - (Th' - Ta) / Rh
+    float a = config_.winding_heat_capacity / dt;
+    float b = config_.housing_heat_capacity / dt;
+    float g = 1.0f / config_.winding_thermal_resistance;
+    float h = 1.0f / config_.housing_thermal_resistance;
+    float rhs_w = a * tm.winding_temp + tm.copper_losses;
+    float rhs_h = b * tm.housing_temp + h * config_.ambient_temp;
+    float det = (a + g) * (b + g + h) - g * g;
+    tm.winding_temp = (rhs_w * (b + g + h) + g * rhs_h) / det;
+    tm.housing_temp = (rhs_h * (a + g) + g * rhs_w) / det;
+}
+
 bool Motor::update_thermal_limits() {
     float fet_temp = get_inverter_temp();
     float temp_margin = config_.inverter_temp_limit_upper - fet_temp;
     float derating_range = config_.inverter_temp_limit_upper - config_.inverter_temp_limit_lower;
     thermal_current_lim_ = config_.current_lim * (temp_margin / derating_range);
+    // Same derating based on the winding temperature, if it is known
+    update_motor_thermal_model();
+    float winding_temp = NAN;
+    if (config_.thermal_model_enable)
+        winding_temp = thermal_model_.winding_temp;
+    if (config_.resistance_estimation_enable && phase_resistance_est_ > 0.0f)
+        winding_temp = fmaxf(winding_temp, winding_temp_est_); // ignores NaN
+    if (!isnan(winding_temp)) {
+        float winding_temp_margin = config_.motor_temp_limit_upper - winding_temp;
+        float winding_derating_range = config_.motor_temp_limit_upper - config_.motor_temp_limit_lower;
+        thermal_current_lim_ = std::min(thermal_current_lim_,
+                config_.current_lim * (winding_temp_margin / winding_derating_range));
+    }
     if (!(thermal_current_lim_ >= 0.0f)) { //Funny polarity to also catch NaN
         thermal_current_lim_ = 0.0f;
     }
@@ -176,7 +247,7 @@ bool Motor::do_checks() {
     return true;
 }
 
-float Motor::effective_current_lim() {
+__RAM_FUNC float Motor::effective_current_lim() {
     // Configured limit
     float current_lim = config_.current_lim;
     // Hardware limit
@@ -191,16 +262,24 @@ float Motor::effective_current_lim() {
     return current_lim;
 }
 
-void Motor::log_timing(TimingLog_t log_idx) {
-    static const uint16_t clocks_per_cnt = (uint16_t)((float)TIM_1_8_CLOCK_HZ / (float)TIM_APB1_CLOCK_HZ);
-    uint16_t timing = clocks_per_cnt * htim13.Instance->CNT; // TODO: Use a hw_config
+// @brief Returns the phase resistance to be used by the motor models.
+// This is the online estimate if resistance estimation is enabled and has
+// produced one, and the calibrated phase_resistance otherwise.
+__RAM_FUNC float Motor::effective_phase_resistance() {
+    if (config_.resistance_estimation_enable && phase_resistance_est_ > 0.0f)
+        return phase_resistance_est_;
+    return config_.phase_resistance;
+}
+
+__RAM_FUNC void Motor::log_timing(TimingLog_t log_idx) {
+    uint16_t timing = timing_clocks_now();
 
     if (log_idx < TIMING_LOG_NUM_SLOTS) {
         timing_log_[log_idx] = timing;
     }
 }
 
-float Motor::phase_current_from_adcval(uint32_t ADCValue) {
+__RAM_FUNC float Motor::phase_current_from_adcval(uint32_t ADCValue) {
     int adcval_bal = (int)ADCValue - (1 << 11);
     float amp_out_volt = (3.3f / (float)(1 << 12)) * (float)adcval_bal;
     float shunt_volt = amp_out_volt * phase_current_rev_gain_;
@@ -212,16 +291,74 @@ float Motor::phase_current_from_adcval(uint32_t ADCValue) {
 // Measurement and calibration
 //--------------------------------
 
+// @brief Decides when a step of the motor calibration is done.
+// The samples are averaged over blocks of 20ms. The step ends once the
+// average changes by less than calibration_tolerance (relative) from one
+// block to the next, within calibration_min_duration and
+// calibration_max_duration. With cumulative set, the average runs over all
+// samples so far, which suits values that are constant but noisy. Otherwise
+// each block is averaged on its own, which suits values that settle.
+struct CalibrationConvergence {
+    CalibrationConvergence(const Motor::Config_t& config, float sample_period, bool cumulative) :
+            sample_period_(sample_period),
+            min_samples_((uint32_t)(config.calibration_min_duration / sample_period)),
+            max_samples_(std::max((uint32_t)(config.calibration_max_duration / sample_period), (uint32_t)1)),
+            block_samples_(std::min(std::max((uint32_t)(0.02f / sample_period), (uint32_t)1), max_samples_)),
+            tolerance_(config.calibration_tolerance),
+            cumulative_(cumulative) {}
+
+    // @returns true once the step is done
+    bool update(float sample) {
+        sum_ += sample;
+        ++n_;
+        if (n_ % block_samples_ == 0) {
+            float mean = sum_ / (float)(cumulative_ ? n_ : block_samples_);
+            change_ = fabsf((mean - value_) / mean); // NaN for the first block
+            value_ = mean;
+            if (!cumulative_)
+                sum_ = 0.0f;
+            if (n_ >= min_samples_ && change_ < tolerance_)
+                return true;
+        }
+        if (n_ < max_samples_)
+            return false;
+        if (cumulative_)
+            value_ = sum_ / (float)n_;
+        return true;
+    }
+
+    float duration() const { return (float)n_ * sample_period_; }
+
+    const float sample_period_; // [s]
+    const uint32_t min_samples_;
+    const uint32_t max_samples_;
+    const uint32_t block_samples_;
+    const float tolerance_;
+    const bool cumulative_;
+    uint32_t n_ = 0;
+    float sum_ = 0.0f;
+    float value_ = NAN;  // result, the average of the last block
+    float change_ = NAN; // relative change of the result in the last block
+};
+
 // TODO check Ibeta balance to verify good motor connection
+// @brief Measures the phase resistance and the dead time voltage.
+// The test current is driven along phase A, first at half and then at the
+// full test current, each until the voltage has settled. The slope of the
+// voltage gives the resistance, the offset the voltage lost to the dead time.
 bool Motor::measure_phase_resistance(float test_current, float max_voltage) {
     static const float kI = 10.0f;                                 // [(V/s)/A]
-    static const int num_test_cycles = static_cast<int>(3.0f / CURRENT_MEAS_PERIOD); // Test runs for 3s
     float test_voltage = 0.0f;
+    CalibrationConvergence steps[2] = {
+        CalibrationConvergence(config_, current_meas_period, false), // half current
+        CalibrationConvergence(config_, current_meas_period, false)  // full current
+    };
     
-    size_t i = 0;
+    int step = 0;
     axis_->run_control_loop([&](){
+        float I_target = (step == 0) ? 0.5f * test_current : test_current;
         float Ialpha = -(current_meas_.phB + current_meas_.phC);
-        test_voltage += (kI * current_meas_period) * (test_current - Ialpha);
+        test_voltage += (kI * current_meas_period) * (I_target - Ialpha);
         if (test_voltage > max_voltage || test_voltage < -max_voltage)
             return set_error(ERROR_PHASE_RESISTANCE_OUT_OF_RANGE), false;
 
@@ -230,39 +367,58 @@ bool Motor::measure_phase_resistance(float test_current, float max_voltage) {
             return false; // error set inside enqueue_voltage_timings
         log_timing(TIMING_LOG_MEAS_R);
 
-        return ++i < num_test_cycles;
+        if (steps[step].update(test_voltage))
+            ++step;
+        return step < 2;
     });
-    if (axis_->error_ != Axis::ERROR_NONE)
+    if (axis_->error_ != Axis::ERROR_NONE || step < 2)
         return false;
 
     //// De-energize motor
     //if (!enqueue_voltage_timings(motor, 0.0f, 0.0f))
     //    return false; // error set inside enqueue_voltage_timings
 
-    float R = test_voltage / test_current;
+    calibration_stats_.resistance_duration = steps[0].duration() + steps[1].duration();
+    calibration_stats_.resistance_change = std::max(steps[0].change_, steps[1].change_);
+    float half_current_voltage = steps[0].value_;
+    test_voltage = steps[1].value_;
+    float R = (test_voltage - half_current_voltage) / (0.5f * test_current);
     config_.phase_resistance = R;
+    // With current flowing out of phase A and back through B and C, the dead
+    // time shifts the alpha voltage by 4/3 of the voltage error of one leg.
+    float V_offset = 2.0f * half_current_voltage - test_voltage;
+    config_.dead_time_voltage = std::max(0.75f * V_offset, 0.0f);
     return true; // if we ran to completion that means success
 }
 
 bool Motor::measure_phase_inductance(float voltage_low, float voltage_high) {
     float test_voltages[2] = {voltage_low, voltage_high};
-    float Ialphas[2] = {0.0f};
-    static const int num_cycles = 5000;
+    float Ialpha_low = 0.0f;
+    // One sample per pair of cycles: the current difference between them
+    CalibrationConvergence convergence(config_, 2.0f * current_meas_period, true);
 
     size_t t = 0;
+    bool done = false;
     axis_->run_control_loop([&](){
         int i = t & 1;
-        Ialphas[i] += -current_meas_.phB - current_meas_.phC;
+        float Ialpha = -current_meas_.phB - current_meas_.phC;
+        if (i == 0)
+            Ialpha_low = Ialpha;
+        else
+            done = convergence.update(Ialpha - Ialpha_low);
 
         // Test voltage along phase A
         if (!enqueue_voltage_timings(test_voltages[i], 0.0f))
             return false; // error set inside enqueue_voltage_timings
         log_timing(TIMING_LOG_MEAS_L);
 
-        return ++t < (num_cycles << 1);
+        ++t;
+        return !done;
     });
-    if (axis_->error_ != Axis::ERROR_NONE)
+    if (axis_->error_ != Axis::ERROR_NONE || !done)
         return false;
+    calibration_stats_.inductance_duration = convergence.duration();
+    calibration_stats_.inductance_change = convergence.change_;
 
     //// De-energize motor
     //if (!enqueue_voltage_timings(motor, 0.0f, 0.0f))
@@ -271,7 +427,7 @@ bool Motor::measure_phase_inductance(float voltage_low, float voltage_high) {
     float v_L = 0.5f * (voltage_high - voltage_low);
     // Note: A more correct formula would also take into account that there is a finite timestep.
     // However, the discretisation in the current control loop inverts the same discrepancy
-    float dI_by_dt = (Ialphas[1] - Ialphas[0]) / (current_meas_period * (float)num_cycles);
+    float dI_by_dt = convergence.value_ / current_meas_period;
     float L = v_L / dI_by_dt;
 
     config_.phase_inductance = L;
@@ -282,6 +438,110 @@ bool Motor::measure_phase_inductance(float voltage_low, float voltage_high) {
 }
 
 
+// @brief Measures Ld and Lq at the current levels of the inductance map.
+// A DC current along alpha aligns the d axis of the rotor with alpha. A small
+// square wave voltage on top of it then gives the incremental inductance, as
+// in measure_phase_inductance: first along alpha (d axis), then along beta
+// (q axis). The levels are measured from the highest down, so the rotor is
+// still aligned when the bias current reaches 0. The ripple of the test
+// current is kept to 20% of max_current.
+bool Motor::run_inductance_map_calibration() {
+    static const float kI = 10.0f;       // [(V/s)/A] bias current controller
+    static const float ramp_time = 0.5f;  // [s] for aligning the rotor
+    static const float settle_time = 0.2f; // [s] at each level
+    static const float meas_time = 0.25f; // [s] per axis and level
+    InductanceMap_t& map = config_.inductance_map;
+
+    if (config_.motor_type != MOTOR_TYPE_HIGH_CURRENT)
+        return set_error(ERROR_NOT_IMPLEMENTED_MOTOR_TYPE), false;
+    if (!(map.max_current > 0.0f && map.max_current <= effective_current_lim()))
+        return axis_->error_ |= Axis::ERROR_INVALID_STATE, false;
+    map.enable = false;
+
+    const float max_voltage = config_.resistance_calib_max_voltage;
+    const float test_voltage = std::min(config_.phase_inductance * 0.2f * map.max_current / current_meas_period,
+                                        0.5f * max_voltage);
+    const uint32_t ramp_cycles = (uint32_t)(ramp_time / current_meas_period);
+    const uint32_t settle_cycles = (uint32_t)(settle_time / current_meas_period);
+    const uint32_t meas_cycles = 2 * (uint32_t)(meas_time / current_meas_period / 2.0f);
+    const uint32_t level_cycles = settle_cycles + 2 * meas_cycles;
+
+    float bias_voltage = 0.0f;
+    float I_sums[2][2] = {{0.0f}}; // [axis][low/high test voltage]
+    int level = inductance_map_size - 1;
+    uint32_t i = 0;
+    axis_->run_control_loop([&](){
+        float I_bias = map.max_current * (float)level / (float)(inductance_map_size - 1);
+        uint32_t t = i;
+        if (level == (int)inductance_map_size - 1) {
+            // Ramp up the first level slowly to align the rotor
+            if (t < ramp_cycles)
+                I_bias *= (float)t / (float)ramp_cycles;
+            t -= std::min(t, ramp_cycles);
+        }
+
+        float Ialpha = -current_meas_.phB - current_meas_.phC;
+        float Ibeta = one_by_sqrt3 * (current_meas_.phB - current_meas_.phC);
+        bias_voltage += (kI * current_meas_period) * (I_bias - Ialpha);
+        if (fabsf(bias_voltage) > max_voltage)
+            return set_error(ERROR_PHASE_RESISTANCE_OUT_OF_RANGE), false;
+
+        // Square wave test voltage on the d (alpha) or q (beta) axis. As in
+        // measure_phase_inductance, the current is attributed to the test
+        // voltage of the same parity, which it is the response to. The first
+        // two measurements of each axis predate its test voltage.
+        float v_test[2] = {0.0f, 0.0f};
+        if (t >= settle_cycles) {
+            uint32_t meas_t = t - settle_cycles;
+            int axis = meas_t < meas_cycles ? 0 : 1;
+            int high = meas_t & 1;
+            if (meas_t % meas_cycles >= 2)
+                I_sums[axis][high] += axis == 0 ? Ialpha : Ibeta;
+            v_test[axis] = high ? test_voltage : -test_voltage;
+        }
+        if (!enqueue_voltage_timings(bias_voltage + v_test[0], v_test[1]))
+            return false; // error set inside enqueue_voltage_timings
+        log_timing(TIMING_LOG_MEAS_L);
+
+        if (t + 1 < level_cycles) {
+            ++i;
+            return true;
+        }
+
+        // End of the level
+        float L[2];
+        for (int axis = 0; axis < 2; ++axis) {
+            float dI = (I_sums[axis][1] - I_sums[axis][0]) / (float)(meas_cycles / 2 - 1);
+            L[axis] = test_voltage * current_meas_period / dI;
+            if (!(L[axis] >= 2e-6f && L[axis] <= 4000e-6f))
+                return set_error(ERROR_PHASE_INDUCTANCE_OUT_OF_RANGE), false;
+        }
+        map.Ld[level] = L[0];
+        map.Lq[level] = L[1];
+        I_sums[0][0] = I_sums[0][1] = I_sums[1][0] = I_sums[1][1] = 0.0f;
+        i = 0;
+        return --level >= 0;
+    });
+    if (axis_->error_ != Axis::ERROR_NONE || level >= 0)
+        return false;
+
+    map.enable = true;
+    return true;
+}
+
+// @brief Linear interpolation of the inductance map at the current magnitude I [A].
+// Currents beyond max_current get the inductance at max_current.
+__RAM_FUNC void Motor::inductance_map_lookup(float I, float* Ld, float* Lq) {
+    const InductanceMap_t& map = config_.inductance_map;
+    float x = I * (float)(inductance_map_size - 1) / map.max_current;
+    if (!(x > 0.0f)) // also catches NaN
+        x = 0.0f;
+    size_t i = std::min((size_t)x, inductance_map_size - 2);
+    float frac = std::min(x - (float)i, 1.0f);
+    *Ld = map.Ld[i] + frac * (map.Ld[i + 1] - map.Ld[i]);
+    *Lq = map.Lq[i] + frac * (map.Lq[i + 1] - map.Lq[i]);
+}
+
 bool Motor::run_calibration() {
     float R_calib_max_voltage = config_.resistance_calib_max_voltage;
     if (config_.motor_type == MOTOR_TYPE_HIGH_CURRENT) {
@@ -301,42 +561,77 @@ bool Motor::run_calibration() {
     return true;
 }
 
-bool Motor::enqueue_modulation_timings(float mod_alpha, float mod_beta) {
+__RAM_FUNC bool Motor::enqueue_modulation_timings(float mod_alpha, float mod_beta) {
     float tA, tB, tC;
     if (SVM(mod_alpha, mod_beta, &tA, &tB, &tC) != 0)
         return set_error(ERROR_MODULATION_MAGNITUDE), false;
-    next_timings_[0] = (uint16_t)(tA * (float)TIM_1_8_PERIOD_CLOCKS);
-    next_timings_[1] = (uint16_t)(tB * (float)TIM_1_8_PERIOD_CLOCKS);
-    next_timings_[2] = (uint16_t)(tC * (float)TIM_1_8_PERIOD_CLOCKS);
+    next_timings_[0] = (uint16_t)(tA * (float)tim_1_8_period_clocks);
+    next_timings_[1] = (uint16_t)(tB * (float)tim_1_8_period_clocks);
+    next_timings_[2] = (uint16_t)(tC * (float)tim_1_8_period_clocks);
+    if (config_.modulation_type == MODULATION_TYPE_DPWM_MIN) {
+        // Shift the common mode voltage down until the lowest phase stays at
+        // DC- for the whole period (CCR = ARR). The line voltages are unchanged.
+        uint16_t shift = tim_1_8_period_clocks
+                - std::max(next_timings_[0], std::max(next_timings_[1], next_timings_[2]));
+        next_timings_[0] += shift;
+        next_timings_[1] += shift;
+        next_timings_[2] += shift;
+    }
+    next_mod_alpha_ = mod_alpha;
+    next_mod_beta_ = mod_beta;
     next_timings_valid_ = true;
     return true;
 }
 
 bool Motor::enqueue_voltage_timings(float v_alpha, float v_beta) {
-    float vfactor = 1.0f / ((2.0f / 3.0f) * vbus_voltage);
-    float mod_alpha = vfactor * v_alpha;
-    float mod_beta = vfactor * v_beta;
+    float mod_alpha = vbus_V_to_mod * v_alpha;
+    float mod_beta = vbus_V_to_mod * v_beta;
     if (!enqueue_modulation_timings(mod_alpha, mod_beta))
         return false;
     log_timing(TIMING_LOG_FOC_VOLTAGE);
     return true;
 }
 
+// @brief Computes the stationary frame voltage that makes up for the dead time
+// at the given phase currents.
+// Each inverter leg loses dead_time_voltage in the direction of its current.
+// Within dead_time_current_band of zero the compensation is scaled down
+// linearly, so that ripple around the zero crossing doesn't make it chatter.
+__RAM_FUNC void Motor::dead_time_compensation(float Ialpha, float Ibeta, float* V_alpha, float* V_beta) {
+    float I_abc[3] = {
+        Ialpha,
+        -0.5f * Ialpha + sqrt3_by_2 * Ibeta,
+        -0.5f * Ialpha - sqrt3_by_2 * Ibeta
+    };
+    float V_abc[3];
+    for (size_t i = 0; i < 3; ++i) {
+        if (fabsf(I_abc[i]) >= config_.dead_time_current_band)
+            V_abc[i] = copysignf(config_.dead_time_voltage, I_abc[i]);
+        else
+            V_abc[i] = config_.dead_time_voltage * I_abc[i] / config_.dead_time_current_band;
+    }
+
+    // Clarke transform
+    *V_alpha = (2.0f / 3.0f) * V_abc[0] - (1.0f / 3.0f) * (V_abc[1] + V_abc[2]);
+    *V_beta = one_by_sqrt3 * (V_abc[1] - V_abc[2]);
+}
+
 // We should probably make FOC Current call FOC Voltage to avoid duplication.
 bool Motor::FOC_voltage(float v_d, float v_q, float pwm_phase) {
-    float c = our_arm_cos_f32(pwm_phase);
-    float s = our_arm_sin_f32(pwm_phase);
+    float c, s;
+    our_arm_sincos_f32(pwm_phase, &s, &c);
     float v_alpha = c*v_d - s*v_q;
     float v_beta  = c*v_q + s*v_d;
     return enqueue_voltage_timings(v_alpha, v_beta);
 }
 
-bool Motor::FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_phase) {
+__RAM_FUNC bool Motor::FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_phase, float phase_vel) {
     // Syntactic sugar
     CurrentControl_t& ictrl = current_control_;
 
     // For Reporting
     ictrl.Iq_setpoint = Iq_des;
+    ictrl.Id_setpoint = Id_des;
 
     // Check for current sense saturation
     if (fabsf(current_meas_.phB) > ictrl.overcurrent_trip_level
@@ -348,9 +643,12 @@ bool Motor::FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_pha
     float Ialpha = -current_meas_.phB - current_meas_.phC;
     float Ibeta = one_by_sqrt3 * (current_meas_.phB - current_meas_.phC);
 
+    // pwm_phase is I_phase advanced by the delay until the voltage is
+    // applied, so its sine and cosine are obtained by a small rotation.
+    float c_I, s_I, c_p, s_p;
+    our_arm_sincos_advance_f32(I_phase, pwm_phase - I_phase, &s_I, &c_I, &s_p, &c_p);
+
     // Park transform
-    float c_I = our_arm_cos_f32(I_phase);
-    float s_I = our_arm_sin_f32(I_phase);
     float Id = c_I * Ialpha + s_I * Ibeta;
     float Iq = c_I * Ibeta - s_I * Ialpha;
     ictrl.Iq_measured += ictrl.I_measured_report_filter_k * (Iq - ictrl.Iq_measured);
@@ -360,42 +658,114 @@ bool Motor::FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_pha
     float Ierr_d = Id_des - Id;
     float Ierr_q = Iq_des - Iq;
 
-    // TODO look into feed forward terms (esp omega, since PI pole maps to RL tau)
+    // Gain scheduling: with the inductance map, the proportional gains follow
+    // the inductance at the measured current, which is what the plant sees
+    // during transients. The integral gain (bandwidth * R, see
+    // update_current_controller_gains) does not depend on the inductance.
+    float Ld = config_.phase_inductance;
+    float Lq = config_.phase_inductance;
+    float p_gain_d = ictrl.p_gain;
+    float p_gain_q = ictrl.p_gain;
+    if (config_.inductance_map.enable) {
+        inductance_map_lookup(sqrtf(Id * Id + Iq * Iq), &Ld, &Lq);
+        p_gain_d = config_.current_control_bandwidth * Ld;
+        p_gain_q = config_.current_control_bandwidth * Lq;
+    }
+
     // Apply PI control
-    float Vd = ictrl.v_current_control_integral_d + Ierr_d * ictrl.p_gain;
-    float Vq = ictrl.v_current_control_integral_q + Ierr_q * ictrl.p_gain;
+    float Vd = ictrl.v_current_control_integral_d + Ierr_d * p_gain_d;
+    float Vq = ictrl.v_current_control_integral_q + Ierr_q * p_gain_q;
+
+    // Feed forward the parts of the motor voltage equation that are known, so
+    // that the integrators only have to correct for model errors:
+    //   Vd = R*Id - omega*Lq*Iq
+    //   Vq = R*Iq + omega*Ld*Id + omega*flux_linkage
+    if (config_.current_control_decoupling) {
+        float R = effective_phase_resistance();
+        Vd += R * Id_des - phase_vel * Lq * Iq_des;
+        Vq += R * Iq_des + phase_vel * Ld * Id_des;
+    }
+    if (config_.back_emf_feedforward)
+        Vq += phase_vel * axis_->sensorless_estimator_.config_.pm_flux_linkage;
+
+    // Dead time compensation, based on the current setpoints at the time the
+    // voltage is applied. It is added before the modulation limit so that
+    // the result stays within the range of SVM.
+    float V_dt_alpha = 0.0f;
+    float V_dt_beta = 0.0f;
+    float V_dt_d = 0.0f;
+    if (config_.dead_time_compensation_enable) {
+        float Ialpha_des = c_p * Id_des - s_p * Iq_des;
+        float Ibeta_des = c_p * Iq_des + s_p * Id_des;
+        dead_time_compensation(Ialpha_des, Ibeta_des, &V_dt_alpha, &V_dt_beta);
+        V_dt_d = c_p * V_dt_alpha + s_p * V_dt_beta;
+        Vd += V_dt_d;
+        Vq += c_p * V_dt_beta - s_p * V_dt_alpha;
+    }
 
     float mod_to_V = (2.0f / 3.0f) * vbus_voltage;
-    float V_to_mod = 1.0f / mod_to_V;
-    float mod_d = V_to_mod * Vd;
-    float mod_q = V_to_mod * Vq;
-
-    // Vector modulation saturation, lock integrator if saturated
-    // TODO make maximum modulation configurable
-    float mod_scalefactor = 0.80f * sqrt3_by_2 * 1.0f / sqrtf(mod_d * mod_d + mod_q * mod_q);
-    if (mod_scalefactor < 1.0f) {
-        mod_d *= mod_scalefactor;
-        mod_q *= mod_scalefactor;
-        // TODO make decayfactor configurable
-        ictrl.v_current_control_integral_d *= 0.99f;
-        ictrl.v_current_control_integral_q *= 0.99f;
-    } else {
-        ictrl.v_current_control_integral_d += Ierr_d * (ictrl.i_gain * current_meas_period);
-        ictrl.v_current_control_integral_q += Ierr_q * (ictrl.i_gain * current_meas_period);
+    float mod_d = vbus_V_to_mod * Vd;
+    float mod_q = vbus_V_to_mod * Vq;
+
+    // Modulation limit. Without overmodulation it stays within the linear
+    // range of SVM, i.e. the circle inscribed in the SVM hexagon. The floor
+    // keeps invalid settings (zero, negative or NaN) from dividing by zero.
+    float max_mod_ratio = std::max(0.01f, std::min(config_.max_modulation, config_.overmodulation_enable ? two_by_sqrt3 : 1.0f));
+    float max_mod = max_mod_ratio * sqrt3_by_2;
+    float mod_ratio = sqrtf(mod_d * mod_d + mod_q * mod_q) / max_mod;
+
+    // Field weakening: integrate negative Id while the modulation is above
+    // the threshold and back off again once there is enough voltage headroom.
+    // The result is applied from the next setpoint on (see dq_current_setpoints).
+    if (config_.field_weakening_enable) {
+        float Id_fw = ictrl.Id_field_weakening
+                + (config_.field_weakening_mod_threshold - mod_ratio) * (config_.field_weakening_gain * current_meas_period);
+        ictrl.Id_field_weakening = std::max(-config_.field_weakening_current_lim, std::min(Id_fw, 0.0f));
     }
 
-    // Compute estimated bus current
-    ictrl.Ibus = mod_d * Id + mod_q * Iq;
+    // Vector modulation saturation
+    float mod_scalefactor = (mod_ratio > 1.0f) ? 1.0f / mod_ratio : 1.0f;
 
     // Inverse park transform
-    float c_p = our_arm_cos_f32(pwm_phase);
-    float s_p = our_arm_sin_f32(pwm_phase);
-    float mod_alpha = c_p * mod_d - s_p * mod_q;
-    float mod_beta  = c_p * mod_q + s_p * mod_d;
+    float mod_alpha = mod_scalefactor * (c_p * mod_d - s_p * mod_q);
+    float mod_beta  = mod_scalefactor * (c_p * mod_q + s_p * mod_d);
+
+    // Overmodulation: vectors that leave the SVM hexagon are pulled back onto
+    // its edge, keeping their angle (minimum phase error method). The margin
+    // keeps rounding errors from failing the range check in SVM().
+    // Note that the low-side on-time of the phase with the highest duty cycle
+    // approaches zero on the edge, which degrades the current measurement.
+    if (config_.overmodulation_enable) {
+        float hex_ratio = std::max(fabsf(mod_alpha + one_by_sqrt3 * mod_beta),
+                          std::max(fabsf(mod_alpha - one_by_sqrt3 * mod_beta), fabsf(two_by_sqrt3 * mod_beta)));
+        if (hex_ratio > 0.9999f) {
+            float hex_scalefactor = 0.9999f / hex_ratio;
+            mod_alpha *= hex_scalefactor;
+            mod_beta *= hex_scalefactor;
+            mod_scalefactor *= hex_scalefactor;
+        }
+    }
+
+    // Back-calculation anti-windup with a tracking time constant of one
+    // current measurement period: while the output is limited, the integrators
+    // give up the part of the voltage that could not be applied. The controller
+    // then leaves saturation as soon as the current error starts to shrink.
+    float V_excess_factor = (1.0f - mod_scalefactor) * mod_to_V;
+    ictrl.v_current_control_integral_d += Ierr_d * (ictrl.i_gain * current_meas_period) - V_excess_factor * mod_d;
+    ictrl.v_current_control_integral_q += Ierr_q * (ictrl.i_gain * current_meas_period) - V_excess_factor * mod_q;
+
+    // Compute estimated bus current
+    ictrl.Ibus = mod_scalefactor * (mod_d * Id + mod_q * Iq);
 
     // Report final applied voltage in stationary frame (for sensorles estimator)
-    ictrl.final_v_alpha = mod_to_V * mod_alpha;
-    ictrl.final_v_beta = mod_to_V * mod_beta;
+    // This excludes the dead time compensation, which is lost in the inverter.
+    // The compensation went through the modulation limit with the rest of
+    // the voltage, so it is scaled the same way.
+    ictrl.final_v_alpha = mod_to_V * mod_alpha - mod_scalefactor * V_dt_alpha;
+    ictrl.final_v_beta = mod_to_V * mod_beta - mod_scalefactor * V_dt_beta;
+
+    if (resistance_estimation_active())
+        update_resistance_estimate(mod_scalefactor * (mod_to_V * mod_d - V_dt_d), Id, mod_scalefactor < 1.0f);
 
     // Apply SVM
     if (!enqueue_modulation_timings(mod_alpha, mod_beta))
@@ -405,6 +775,107 @@ bool Motor::FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_pha
     return true;
 }
 
+// @brief Resistance estimation only runs in the closed loop states, where the
+// injected d axis current does not disturb calibration or lock-in.
+__RAM_FUNC bool Motor::resistance_estimation_active() {
+    return config_.resistance_estimation_enable
+        && (axis_->current_state_ == Axis::AXIS_STATE_CLOSED_LOOP_CONTROL
+         || axis_->current_state_ == Axis::AXIS_STATE_SENSORLESS_CONTROL);
+}
+
+// @brief Updates the phase resistance estimate with one current controller cycle.
+// The injected d axis current alternates between +/- resistance_estimation_current
+// every half period. Vd and Id are averaged over the second half of each half
+// period, when the current controller has settled. The change of the mean d
+// axis voltage over the change of the mean d axis current between two half
+// periods then gives the resistance. Terms that stay constant, such as the
+// omega*L*Iq cross-coupling and voltage offsets, cancel out.
+// @param Vd: d axis voltage applied in this cycle, excluding dead time compensation [V]
+// @param Id: measured d axis current [A]
+// @param saturated: true if the output of the current controller was limited
+__RAM_FUNC void Motor::update_resistance_estimate(float Vd, float Id, bool saturated) {
+    static const float filter_k = 0.02f; // per resistance sample, the winding heats up slowly
+    ResistanceEstimator_t& est = resistance_estimator_;
+
+    uint32_t half_period_cycles = (uint32_t)(0.5f * config_.resistance_estimation_period * (float)current_meas_hz);
+    if (half_period_cycles < 2)
+        half_period_cycles = 2;
+
+    if (saturated)
+        est.samples_valid = false;
+    if (est.cycle >= half_period_cycles / 2) {
+        est.Vd_sum += Vd;
+        est.Id_sum += Id;
+        est.n_samples++;
+    }
+    if (++est.cycle < half_period_cycles)
+        return;
+
+    // End of the half period
+    float Vd_mean = est.Vd_sum / (float)est.n_samples;
+    float Id_mean = est.Id_sum / (float)est.n_samples;
+    float dId = Id_mean - est.Id_mean_prev;
+    if (est.samples_valid && est.prev_valid
+            && fabsf(dId) > config_.resistance_estimation_current) {
+        float R = (Vd_mean - est.Vd_mean_prev) / dId;
+        // Reject samples that can't be explained by any reasonable temperature
+        float R_cal = config_.phase_resistance;
+        if (R > 0.5f * R_cal && R < 2.0f * R_cal) {
+            if (phase_resistance_est_ > 0.0f)
+                phase_resistance_est_ += filter_k * (R - phase_resistance_est_);
+            else
+                phase_resistance_est_ = R_cal + filter_k * (R - R_cal);
+            winding_temp_est_ = config_.phase_resistance_ref_temp
+                    + (phase_resistance_est_ / R_cal - 1.0f) / config_.phase_resistance_temp_coeff;
+        }
+    }
+
+    est.prev_valid = est.samples_valid;
+    est.Vd_mean_prev = Vd_mean;
+    est.Id_mean_prev = Id_mean;
+    est.injection_positive = !est.injection_positive;
+    est.cycle = 0;
+    est.n_samples = 0;
+    est.samples_valid = true;
+    est.Vd_sum = 0.0f;
+    est.Id_sum = 0.0f;
+}
+
+// @brief Splits the current setpoint into d and q axis current setpoints.
+// Without MTPA and field weakening, all current goes into the q axis.
+__RAM_FUNC void Motor::dq_current_setpoints(float I_des, float* Id_des, float* Iq_des) {
+    float Id = 0.0f;
+    float Iq = I_des;
+
+    if (config_.mtpa_enable && config_.phase_inductance_saliency > 0.0f) {
+        // Current angle with the maximum torque for a given current magnitude:
+        //   Id = (flux - sqrt(flux^2 + 8*dL^2*I^2)) / (4*dL), dL = Lq - Ld
+        float flux = axis_->sensorless_estimator_.config_.pm_flux_linkage;
+        float dL = config_.phase_inductance_saliency;
+        Id = (flux - sqrtf(flux * flux + 8.0f * dL * dL * I_des * I_des)) / (4.0f * dL);
+        Id = std::max(Id, -config_.negative_id_lim);
+        Iq = copysignf(sqrtf(std::max(I_des * I_des - Id * Id, 0.0f)), I_des);
+    }
+
+    if (config_.field_weakening_enable)
+        Id = std::max(Id + current_control_.Id_field_weakening, -config_.negative_id_lim);
+
+    if (resistance_estimation_active()) {
+        Id += resistance_estimator_.injection_positive ?
+                config_.resistance_estimation_current : -config_.resistance_estimation_current;
+    }
+
+    // Keep the current magnitude within the limit by giving up q axis current.
+    // Field weakening and the resistance estimation injection add Id on top
+    // of a q axis current that may already be at the limit.
+    float Ilim = effective_current_lim();
+    Id = std::max(-Ilim, std::min(Id, Ilim));
+    float Iq_lim = sqrtf(std::max(Ilim * Ilim - Id * Id, 0.0f));
+    Iq = std::max(-Iq_lim, std::min(Iq, Iq_lim));
+
+    *Id_des = Id;
+    *Iq_des = Iq;
+}
 
 bool Motor::update(float current_setpoint, float phase, float phase_vel) {
     current_setpoint *= config_.direction;
@@ -416,12 +887,33 @@ bool Motor::update(float current_setpoint, float phase, float phase_vel) {
     // Execute current command
     // TODO: move this into the mot
     if (config_.motor_type == MOTOR_TYPE_HIGH_CURRENT) {
-        if(!FOC_current(0.0f, current_setpoint, phase, pwm_phase)){
+        if (current_control_in_isr_) {
+            // Hand the command over to the ADC interrupt, which runs the current
+            // controller as soon as the next measurement arrives (see current_meas_cb).
+            uint32_t mask = cpu_enter_critical();
+            isr_current_command_ = { current_setpoint, phase, phase_vel };
+            isr_current_command_pending_ = true;
+            cpu_exit_critical(mask);
+            log_timing(TIMING_LOG_CURRENT_CMD);
+            // Right after arming the interrupt has not queued any timings yet,
+            // so the first ones are computed here.
+            if (armed_state_ != ARMED_STATE_WAITING_FOR_TIMINGS)
+                return true;
+        }
+        float Id_des, Iq_des;
+        dq_current_setpoints(current_setpoint, &Id_des, &Iq_des);
+        uint32_t start_cycles = cycles_now();
+        bool foc_ok = FOC_current(Id_des, Iq_des, phase, pwm_phase, phase_vel);
+        axis_->profiler_.record(Profiler::SLOT_FOC, cycles_now() - start_cycles);
+        if(!foc_ok){
             return false;
         }
     } else if (config_.motor_type == MOTOR_TYPE_GIMBAL) {
         //In gimbal motor mode, current is reinterptreted as voltage.
-        if(!FOC_voltage(0.0f, current_setpoint, pwm_phase))
+        uint32_t start_cycles = cycles_now();
+        bool foc_ok = FOC_voltage(0.0f, current_setpoint, pwm_phase);
+        axis_->profiler_.record(Profiler::SLOT_FOC, cycles_now() - start_cycles);
+        if(!foc_ok)
             return false;
     } else {
         set_error(ERROR_NOT_IMPLEMENTED_MOTOR_TYPE);
@@ -429,3 +921,35 @@ bool Motor::update(float current_setpoint, float phase, float phase_vel) {
     }
     return true;
 }
+
+// @brief Runs the current controller in the ADC interrupt.
+// Called once both phase currents of a measurement are available. Does nothing
+// unless current_control_in_isr_ is set and the control loop has handed over
+// a new command since the last measurement. If the control loop stalls, no
+// timings are queued and the motor is disarmed with ERROR_CONTROL_DEADLINE_MISSED,
+// same as when the current controller runs in the thread.
+// Also accumulates the squared current for the thermal model.
+__RAM_FUNC void Motor::current_meas_cb() {
+    if (config_.thermal_model_enable) {
+        float Ialpha = -current_meas_.phB - current_meas_.phC;
+        float Ibeta = one_by_sqrt3 * (current_meas_.phB - current_meas_.phC);
+        thermal_model_.I_sqr_sum += Ialpha * Ialpha + Ibeta * Ibeta;
+        thermal_model_.n_samples++;
+    }
+
+    if (!current_control_in_isr_ || !isr_current_command_pending_)
+        return;
+    isr_current_command_pending_ = false;
+    if (armed_state_ == ARMED_STATE_DISARMED)
+        return;
+
+    // The command was computed for the previous measurement
+    const CurrentCommand_t& cmd = isr_current_command_;
+    float phase = cmd.phase + current_meas_period * cmd.phase_vel;
+    float pwm_phase = phase + 1.5f * current_meas_period * cmd.phase_vel;
+    float Id_des, Iq_des;
+    dq_current_setpoints(cmd.current_setpoint, &Id_des, &Iq_des);
+    uint32_t start_cycles = cycles_now();
+    FOC_current(Id_des, Iq_des, phase, pwm_phase, cmd.phase_vel);
+    axis_->profiler_.record_from_isr(Profiler::SLOT_FOC, cycles_now() - start_cycles);
+}
@@ -31,6 +31,53 @@ public:
         MOTOR_TYPE_GIMBAL = 2
     };
 
+    enum ModulationType_t {
+        MODULATION_TYPE_SVM = 0,      // continuous, centered space vector modulation
+        MODULATION_TYPE_DPWM_MIN = 1, // discontinuous, the lowest phase is clamped to DC-
+    };
+
+    // State of the online resistance estimation (see update_resistance_estimate)
+    struct ResistanceEstimator_t {
+        bool injection_positive; // sign of the d axis current injected in this half period
+        uint32_t cycle;          // current measurements since the start of the half period
+        uint32_t n_samples;
+        bool samples_valid;      // false once the current controller saturated in this half period
+        float Vd_sum;            // [V]
+        float Id_sum;            // [A]
+        bool prev_valid;
+        float Vd_mean_prev;      // [V] mean of the previous half period
+        float Id_mean_prev;      // [A]
+    };
+
+    struct ThermalModel_t {
+        float winding_temp;  // [degC]
+        float housing_temp;  // [degC]
+        float copper_losses; // [W] average since the previous update
+        // Accumulated by current_meas_cb, consumed by update_motor_thermal_model
+        float I_sqr_sum;     // [A^2] sum of the squared current vector magnitudes
+        uint32_t n_samples;
+    };
+
+    static constexpr size_t inductance_map_size = 5;
+
+    // Inductance at inductance_map_size current magnitudes, evenly spaced
+    // from 0 to max_current (see run_inductance_map_calibration).
+    struct InductanceMap_t {
+        bool enable = false; // set by run_inductance_map_calibration
+        float max_current = 10.0f; // [A]
+        float Ld[inductance_map_size] = {0.0f}; // [H]
+        float Lq[inductance_map_size] = {0.0f}; // [H]
+    };
+
+    // Duration and last relative change (see calibration_tolerance) of the
+    // most recent resistance and inductance measurements
+    struct CalibrationStats_t {
+        float resistance_duration;  // [s] both steps together
+        float resistance_change;
+        float inductance_duration;  // [s]
+        float inductance_change;
+    };
+
     struct Iph_BC_t {
         float phB;
         float phC;
@@ -46,13 +93,23 @@ public:
         float final_v_alpha; // [V]
         float final_v_beta; // [V]
         float Iq_setpoint; // [A]
+        float Id_setpoint; // [A]
         float Iq_measured; // [A]
         float Id_measured; // [A]
+        float Id_field_weakening; // [A] output of the field weakening regulator
         float I_measured_report_filter_k;
         float max_allowed_current; // [A]
         float overcurrent_trip_level; // [A]
     };
 
+    // Current command handed from the control loop thread to the ADC interrupt
+    // when the current controller runs in the interrupt.
+    struct CurrentCommand_t {
+        float current_setpoint; // [A] before the split into Id and Iq
+        float phase; // [rad] electrical phase at the measurement the command was computed for
+        float phase_vel; // [rad/s]
+    };
+
     // NOTE: for gimbal motors, all units of A are instead V.
     // example: vel_gain is [V/(count/s)] instead of [A/(count/s)]
     // example: current_lim and calibration_current will instead determine the maximum voltage applied to the motor.
@@ -61,8 +118,21 @@ public:
         int32_t pole_pairs = 7;
         float calibration_current = 10.0f;    // [A]
         float resistance_calib_max_voltage = 2.0f; // [V] - You may need to increase this if this voltage isn't sufficient to drive calibration_current through the motor.
+        // Each step of the resistance and inductance measurement ends once its
+        // result changes by less than calibration_tolerance (relative) from
+        // one 20ms block to the next, but runs at least calibration_min_duration
+        // and at most calibration_max_duration. Set both to the same value for
+        // a fixed length.
+        float calibration_min_duration = 0.1f; // [s]
+        float calibration_max_duration = 1.5f; // [s]
+        float calibration_tolerance = 1e-4f;
         float phase_inductance = 0.0f;        // to be set by measure_phase_inductance
         float phase_resistance = 0.0f;        // to be set by measure_phase_resistance
+        // Voltage error of one inverter leg caused by the dead time, to be set by
+        // measure_phase_resistance. Only used if dead_time_compensation_enable is set.
+        float dead_time_voltage = 0.0f;       // [V]
+        bool dead_time_compensation_enable = false;
+        float dead_time_current_band = 1.0f;  // [A] compensation is scaled down linearly below this current
         int32_t direction = 0;                // 1 or -1 (0 = unspecified)
         MotorType_t motor_type = MOTOR_TYPE_HIGH_CURRENT;
         // Read out max_allowed_current to see max supported value for current_lim.
@@ -71,8 +141,63 @@ public:
         // Value used to compute shunt amplifier gains
         float requested_current_range = 60.0f; // [A]
         float current_control_bandwidth = 1000.0f;  // [rad/s]
+        // Run the current controller directly in the ADC interrupt instead of the
+        // axis thread. Only applies to high current motors. Takes effect on the next arm.
+        bool current_control_in_isr = false;
+        // If enabled, the current controller takes the proportional gains and
+        // the decoupling inductances from this map instead of phase_inductance.
+        InductanceMap_t inductance_map;
+        // Feed forward the resistive drop and the d/q cross-coupling (omega * L)
+        // of the current setpoint, based on phase_resistance and phase_inductance.
+        bool current_control_decoupling = false;
+        // Feed forward the back-EMF, based on the pm_flux_linkage of the sensorless estimator.
+        bool back_emf_feedforward = false;
+        // Maximum modulation magnitude as a ratio of the linear range of SVM.
+        // Limited to 1 unless overmodulation is enabled, which allows up to
+        // 2/sqrt(3) (the corners of the SVM hexagon).
+        float max_modulation = 0.8f;
+        bool overmodulation_enable = false;
+        // With DPWM_MIN only two phases switch at any time, which cuts the
+        // switching losses by a third. Phases are clamped to DC- rather than
+        // DC+ because the current is measured on the low side.
+        ModulationType_t modulation_type = MODULATION_TYPE_SVM;
+        // Split the current setpoint into Id and Iq for maximum torque per amp.
+        // Only has an effect on salient motors (phase_inductance_saliency > 0).
+        bool mtpa_enable = false;
+        float phase_inductance_saliency = 0.0f; // [H] Lq - Ld
+        // Inject negative Id when the modulation magnitude exceeds
+        // field_weakening_mod_threshold (ratio of the maximum modulation).
+        bool field_weakening_enable = false;
+        float field_weakening_mod_threshold = 0.9f;
+        float field_weakening_gain = 1000.0f;       // [A/s] per unit of excess modulation ratio
+        float field_weakening_current_lim = 10.0f;  // [A] maximum negative Id injected by field weakening
+        float negative_id_lim = 10.0f;  // [A] maximum total negative Id of MTPA and field weakening
+        // Track the phase resistance during closed loop control by injecting a
+        // square wave on the d axis (see update_resistance_estimate). The
+        // estimate replaces phase_resistance in the sensorless estimator and
+        // the current controller feed forward, and the derived winding
+        // temperature is used for derating.
+        bool resistance_estimation_enable = false;
+        float resistance_estimation_current = 1.0f;  // [A] amplitude of the injected d axis current
+        float resistance_estimation_period = 0.05f;  // [s] period of the injected square wave
+        float phase_resistance_ref_temp = 25.0f;     // [degC] winding temperature at which phase_resistance was measured
+        float phase_resistance_temp_coeff = 0.00393f; // [1/K] copper
         float inverter_temp_limit_lower = 100;
         float inverter_temp_limit_upper = 120;
+        // Lumped thermal model of the motor, driven by the copper losses
+        // (see update_motor_thermal_model). The winding exchanges heat with
+        // the housing, which exchanges heat with the ambient. Set
+        // housing_heat_capacity to 0 for a first order model.
+        bool thermal_model_enable = false;
+        float ambient_temp = 25.0f;              // [degC]
+        float winding_heat_capacity = 40.0f;     // [J/K]
+        float winding_thermal_resistance = 1.0f; // [K/W] winding to housing
+        float housing_heat_capacity = 400.0f;    // [J/K]
+        float housing_thermal_resistance = 1.5f; // [K/W] housing to ambient
+        // Derating range of the winding temperature, from the thermal model
+        // and/or the resistance estimation, whichever is higher.
+        float motor_temp_limit_lower = 100;  // [degC]
+        float motor_temp_limit_upper = 120;  // [degC]
     };
 
     enum TimingLog_t {
@@ -85,6 +210,7 @@ public:
         TIMING_LOG_IDX_SEARCH,
         TIMING_LOG_FOC_VOLTAGE,
         TIMING_LOG_FOC_CURRENT,
+        TIMING_LOG_CURRENT_CMD,
         TIMING_LOG_NUM_SLOTS
     };
 
@@ -103,27 +229,39 @@ public:
     void disarm();
     void setup() {
         DRV8301_setup();
+        reset_thermal_model();
     }
     void reset_current_control();
 
     void update_current_controller_gains();
+    void invalidate_derived_params();
     void DRV8301_setup();
     bool check_DRV_fault();
     void set_error(Error_t error);
     bool do_checks();
     float get_inverter_temp();
+    void reset_thermal_model();
+    void update_motor_thermal_model();
     bool update_thermal_limits();
     float effective_current_lim();
+    float effective_phase_resistance();
     void log_timing(TimingLog_t log_idx);
     float phase_current_from_adcval(uint32_t ADCValue);
     bool measure_phase_resistance(float test_current, float max_voltage);
     bool measure_phase_inductance(float voltage_low, float voltage_high);
     bool run_calibration();
+    bool run_inductance_map_calibration();
+    void inductance_map_lookup(float I, float* Ld, float* Lq);
     bool enqueue_modulation_timings(float mod_alpha, float mod_beta);
     bool enqueue_voltage_timings(float v_alpha, float v_beta);
     bool FOC_voltage(float v_d, float v_q, float pwm_phase);
-    bool FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_phase);
+    void dq_current_setpoints(float I_des, float* Id_des, float* Iq_des);
+    void dead_time_compensation(float Ialpha, float Ibeta, float* V_alpha, float* V_beta);
+    bool resistance_estimation_active();
+    void update_resistance_estimate(float Vd, float Id, bool saturated);
+    bool FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_phase, float phase_vel);
     bool update(float current_setpoint, float phase, float phase_vel);
+    void current_meas_cb();
 
     const MotorHardwareConfig_t& hw_config_;
     const GateDriverHardwareConfig_t gate_driver_config_;
@@ -134,11 +272,17 @@ public:
 
     DRV8301_Obj gate_driver_; // initialized in constructor
     uint16_t next_timings_[3] = {
-        TIM_1_8_PERIOD_CLOCKS / 2,
-        TIM_1_8_PERIOD_CLOCKS / 2,
-        TIM_1_8_PERIOD_CLOCKS / 2
+        (uint16_t)(tim_1_8_period_clocks / 2),
+        (uint16_t)(tim_1_8_period_clocks / 2),
+        (uint16_t)(tim_1_8_period_clocks / 2)
     };
     bool next_timings_valid_ = false;
+    // Modulation of next_timings_, including the dead time compensation
+    float next_mod_alpha_ = 0.0f;
+    float next_mod_beta_ = 0.0f;
+    bool current_control_in_isr_ = false; // latched from config_ on arm()
+    CurrentCommand_t isr_current_command_ = {0.0f, 0.0f, 0.0f};
+    bool isr_current_command_pending_ = false;
     uint16_t last_cpu_time_ = 0;
     int timing_log_index_ = 0;
     uint16_t timing_log_[TIMING_LOG_NUM_SLOTS] = { 0 };
@@ -151,6 +295,11 @@ public:
     bool is_calibrated_ = config_.pre_calibrated;
     Iph_BC_t current_meas_ = {0.0f, 0.0f};
     Iph_BC_t DC_calib_ = {0.0f, 0.0f};
+    // Phases that are clamped to DC- by the last two sets of timings written
+    // to the timer (bit 0: A, bit 1: B, bit 2: C). The shunts of these phases
+    // carry current at the top of the counter, so they can't be DC calibrated.
+    // Cleared when the PWM is disarmed.
+    uint8_t clamped_phases_ = 0;
     float phase_current_rev_gain_ = 0.0f; // Reverse gain for ADC to Amps (to be set by DRV8301_setup)
     CurrentControl_t current_control_ = {
         .p_gain = 0.0f,        // [V/A] should be auto set after resistance and inductance measurement
@@ -161,8 +310,10 @@ public:
         .final_v_alpha = 0.0f,
         .final_v_beta = 0.0f,
         .Iq_setpoint = 0.0f,
+        .Id_setpoint = 0.0f,
         .Iq_measured = 0.0f,
         .Id_measured = 0.0f,
+        .Id_field_weakening = 0.0f,
         .I_measured_report_filter_k = 1.0f,
         .max_allowed_current = 0.0f,
         .overcurrent_trip_level = 0.0f,
@@ -170,9 +321,21 @@ public:
     DRV8301_FaultType_e drv_fault_ = DRV8301_FaultType_NoFault;
     DRV_SPI_8301_Vars_t gate_driver_regs_; //Local view of DRV registers (initialized by DRV8301_setup)
     float thermal_current_lim_ = 10.0f;  //[A]
+    CalibrationStats_t calibration_stats_ = {};
+    ResistanceEstimator_t resistance_estimator_ = {};
+    float phase_resistance_est_ = 0.0f; // [Ohm] 0 until the first estimate
+    float winding_temp_est_ = 0.0f;     // [degC] only valid if phase_resistance_est_ is
+    ThermalModel_t thermal_model_ = {
+        .winding_temp = config_.ambient_temp,
+        .housing_temp = config_.ambient_temp,
+        .copper_losses = 0.0f,
+        .I_sqr_sum = 0.0f,
+        .n_samples = 0,
+    };
 
     // Communication protocol definitions
     auto make_protocol_definitions() {
+        static_assert(inductance_map_size == 5, "update the inductance_map properties below");
         return make_protocol_member_list(
             make_protocol_property("error", &error_),
             make_protocol_ro_property("armed_state", &armed_state_),
@@ -183,7 +346,20 @@ public:
             make_protocol_property("DC_calib_phC", &DC_calib_.phC),
             make_protocol_property("phase_current_rev_gain", &phase_current_rev_gain_),
             make_protocol_ro_property("thermal_current_lim", &thermal_current_lim_),
+            make_protocol_ro_property("phase_resistance_est", &phase_resistance_est_),
+            make_protocol_ro_property("winding_temp_est", &winding_temp_est_),
+            make_protocol_object("thermal_model",
+                make_protocol_ro_property("winding_temp", &thermal_model_.winding_temp),
+                make_protocol_ro_property("housing_temp", &thermal_model_.housing_temp),
+                make_protocol_ro_property("copper_losses", &thermal_model_.copper_losses)
+            ),
             make_protocol_function("get_inverter_temp", *this, &Motor::get_inverter_temp),
+            make_protocol_object("calibration_stats",
+                make_protocol_ro_property("resistance_duration", &calibration_stats_.resistance_duration),
+                make_protocol_ro_property("resistance_change", &calibration_stats_.resistance_change),
+                make_protocol_ro_property("inductance_duration", &calibration_stats_.inductance_duration),
+                make_protocol_ro_property("inductance_change", &calibration_stats_.inductance_change)
+            ),
             make_protocol_object("current_control",
                 make_protocol_property("p_gain", &current_control_.p_gain),
                 make_protocol_property("i_gain", &current_control_.i_gain),
@@ -193,8 +369,10 @@ public:
                 make_protocol_property("final_v_alpha", &current_control_.final_v_alpha),
                 make_protocol_property("final_v_beta", &current_control_.final_v_beta),
                 make_protocol_property("Iq_setpoint", &current_control_.Iq_setpoint),
+                make_protocol_ro_property("Id_setpoint", &current_control_.Id_setpoint),
                 make_protocol_property("Iq_measured", &current_control_.Iq_measured),
                 make_protocol_property("Id_measured", &current_control_.Id_measured),
+                make_protocol_ro_property("Id_field_weakening", &current_control_.Id_field_weakening),
                 make_protocol_property("I_measured_report_filter_k", &current_control_.I_measured_report_filter_k),
                 make_protocol_ro_property("max_allowed_current", &current_control_.max_allowed_current),
                 make_protocol_ro_property("overcurrent_trip_level", &current_control_.overcurrent_trip_level)
@@ -215,23 +393,74 @@ public:
                 make_protocol_ro_property("TIMING_LOG_ENC_CALIB", &timing_log_[TIMING_LOG_ENC_CALIB]),
                 make_protocol_ro_property("TIMING_LOG_IDX_SEARCH", &timing_log_[TIMING_LOG_IDX_SEARCH]),
                 make_protocol_ro_property("TIMING_LOG_FOC_VOLTAGE", &timing_log_[TIMING_LOG_FOC_VOLTAGE]),
-                make_protocol_ro_property("TIMING_LOG_FOC_CURRENT", &timing_log_[TIMING_LOG_FOC_CURRENT])
+                make_protocol_ro_property("TIMING_LOG_FOC_CURRENT", &timing_log_[TIMING_LOG_FOC_CURRENT]),
+                make_protocol_ro_property("TIMING_LOG_CURRENT_CMD", &timing_log_[TIMING_LOG_CURRENT_CMD])
             ),
             make_protocol_object("config",
                 make_protocol_property("pre_calibrated", &config_.pre_calibrated),
-                make_protocol_property("pole_pairs", &config_.pole_pairs),
+                make_protocol_property("pole_pairs", &config_.pole_pairs,
+                    [](void* ctx) { static_cast<Motor*>(ctx)->invalidate_derived_params(); }, this),
                 make_protocol_property("calibration_current", &config_.calibration_current),
                 make_protocol_property("resistance_calib_max_voltage", &config_.resistance_calib_max_voltage),
-                make_protocol_property("phase_inductance", &config_.phase_inductance),
-                make_protocol_property("phase_resistance", &config_.phase_resistance),
+                make_protocol_property("calibration_min_duration", &config_.calibration_min_duration),
+                make_protocol_property("calibration_max_duration", &config_.calibration_max_duration),
+                make_protocol_property("calibration_tolerance", &config_.calibration_tolerance),
+                make_protocol_property("phase_inductance", &config_.phase_inductance,
+                    [](void* ctx) { static_cast<Motor*>(ctx)->invalidate_derived_params(); }, this),
+                make_protocol_property("phase_resistance", &config_.phase_resistance,
+                    [](void* ctx) { static_cast<Motor*>(ctx)->invalidate_derived_params(); }, this),
+                make_protocol_property("dead_time_voltage", &config_.dead_time_voltage),
+                make_protocol_property("dead_time_compensation_enable", &config_.dead_time_compensation_enable),
+                make_protocol_property("dead_time_current_band", &config_.dead_time_current_band),
                 make_protocol_property("direction", &config_.direction),
                 make_protocol_property("motor_type", &config_.motor_type),
                 make_protocol_property("current_lim", &config_.current_lim),
                 make_protocol_property("inverter_temp_limit_lower", &config_.inverter_temp_limit_lower),
                 make_protocol_property("inverter_temp_limit_upper", &config_.inverter_temp_limit_upper),
+                make_protocol_property("motor_temp_limit_lower", &config_.motor_temp_limit_lower),
+                make_protocol_property("motor_temp_limit_upper", &config_.motor_temp_limit_upper),
                 make_protocol_property("requested_current_range", &config_.requested_current_range),
                 make_protocol_property("current_control_bandwidth", &config_.current_control_bandwidth,
-                    [](void* ctx) { static_cast<Motor*>(ctx)->update_current_controller_gains(); }, this)
+                    [](void* ctx) { static_cast<Motor*>(ctx)->update_current_controller_gains(); }, this),
+                make_protocol_property("current_control_in_isr", &config_.current_control_in_isr),
+                make_protocol_object("inductance_map",
+                    make_protocol_property("enable", &config_.inductance_map.enable),
+                    make_protocol_property("max_current", &config_.inductance_map.max_current),
+                    make_protocol_property("Ld_0", &config_.inductance_map.Ld[0]),
+                    make_protocol_property("Ld_1", &config_.inductance_map.Ld[1]),
+                    make_protocol_property("Ld_2", &config_.inductance_map.Ld[2]),
+                    make_protocol_property("Ld_3", &config_.inductance_map.Ld[3]),
+                    make_protocol_property("Ld_4", &config_.inductance_map.Ld[4]),
+                    make_protocol_property("Lq_0", &config_.inductance_map.Lq[0]),
+                    make_protocol_property("Lq_1", &config_.inductance_map.Lq[1]),
+                    make_protocol_property("Lq_2", &config_.inductance_map.Lq[2]),
+                    make_protocol_property("Lq_3", &config_.inductance_map.Lq[3]),
+                    make_protocol_property("Lq_4", &config_.inductance_map.Lq[4])
+                ),
+                make_protocol_property("current_control_decoupling", &config_.current_control_decoupling),
+                make_protocol_property("back_emf_feedforward", &config_.back_emf_feedforward),
+                make_protocol_property("max_modulation", &config_.max_modulation),
+                make_protocol_property("overmodulation_enable", &config_.overmodulation_enable),
+                make_protocol_property("modulation_type", &config_.modulation_type),
+                make_protocol_property("mtpa_enable", &config_.mtpa_enable),
+                make_protocol_property("phase_inductance_saliency", &config_.phase_inductance_saliency),
+                make_protocol_property("field_weakening_enable", &config_.field_weakening_enable),
+                make_protocol_property("field_weakening_mod_threshold", &config_.field_weakening_mod_threshold),
+                make_protocol_property("field_weakening_gain", &config_.field_weakening_gain),
+                make_protocol_property("field_weakening_current_lim", &config_.field_weakening_current_lim),
+                make_protocol_property("negative_id_lim", &config_.negative_id_lim),
+                make_protocol_property("resistance_estimation_enable", &config_.resistance_estimation_enable),
+                make_protocol_property("resistance_estimation_current", &config_.resistance_estimation_current),
+                make_protocol_property("resistance_estimation_period", &config_.resistance_estimation_period),
+                make_protocol_property("phase_resistance_ref_temp", &config_.phase_resistance_ref_temp),
+                make_protocol_property("phase_resistance_temp_coeff", &config_.phase_resistance_temp_coeff),
+                make_protocol_property("thermal_model_enable", &config_.thermal_model_enable),
+                make_protocol_property("ambient_temp", &config_.ambient_temp,
+                    [](void* ctx) { static_cast<Motor*>(ctx)->reset_thermal_model(); }, this),
+                make_protocol_property("winding_heat_capacity", &config_.winding_heat_capacity),
+                make_protocol_property("winding_thermal_resistance", &config_.winding_thermal_resistance),
+                make_protocol_property("housing_heat_capacity", &config_.housing_heat_capacity),
+                make_protocol_property("housing_thermal_resistance", &config_.housing_thermal_resistance)
             )
         );
     }
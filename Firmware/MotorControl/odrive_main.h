@@ -33,9 +33,9 @@ extern "C" {
 //default timeout waiting for phase measurement signals
 #define PH_CURRENT_MEAS_TIMEOUT 2 // [ms]
 
-//TODO clean this up
-static const float current_meas_period = CURRENT_MEAS_PERIOD;
-static const int current_meas_hz = CURRENT_MEAS_HZ;
+// Derived from board_config.pwm_frequency (see configure_pwm)
+extern float current_meas_period;
+extern int current_meas_hz;
 // extern const float elec_rad_per_enc;
 extern uint32_t _reboot_cookie;
 extern bool user_config_loaded_;
@@ -81,6 +81,9 @@ struct BoardConfig_t {
                                                                         //<! This protects against cases in which the power supply fails to dissipate
                                                                         //<! the brake power if the brake resistor is disabled.
                                                                         //<! The default is 26V for the 24V board version and 52V for the 48V board version.
+    float pwm_frequency = (float)TIM_1_8_CLOCK_HZ / (float)(2 * TIM_1_8_PERIOD_CLOCKS); //<! [Hz] requires a reboot
+    bool current_meas_every_pwm_period = false;                         //<! requires a reboot. Otherwise the current is
+                                                                        //<! measured every (TIM_1_8_RCR+1) PWM periods.
     PWMMapping_t pwm_mappings[GPIO_COUNT];
     PWMMapping_t analog_mappings[GPIO_COUNT];
 };
@@ -112,7 +115,11 @@ inline ENUMTYPE operator ~ (ENUMTYPE a) { return static_cast<ENUMTYPE>(~static_c
 
 // ODrive specific includes
 #include <utils.h>
+#include <math_kernels.hpp>
 #include <low_level.h>
+#include <profiler.hpp>
+#include <flight_recorder.hpp>
+#include <encoder_pll.hpp>
 #include <encoder.hpp>
 #include <sensorless_estimator.hpp>
 #include <controller.hpp>
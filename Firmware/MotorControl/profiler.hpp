@@ -0,0 +1,166 @@
+#ifndef __PROFILER_HPP
+#define __PROFILER_HPP
+
+#ifndef __ODRIVE_MAIN_H
+#error "This file should not be included directly. Include odrive_main.h instead."
+#endif
+
+#include <algorithm>
+
+// @brief Returns the CPU cycle counter (DWT CYCCNT, enabled by profiler_init()).
+__RAM_FUNC static inline uint32_t cycles_now() {
+    return DWT->CYCCNT;
+}
+
+void profiler_init();
+
+// @brief Execution time statistics of one profiled section [CPU cycles]
+struct ProfilerSlot_t {
+    // Bucket 0 counts samples below 2^7 cycles, bucket i counts samples in
+    // [2^(i+6), 2^(i+7)) and the last bucket everything from 2^17 (~0.8ms).
+    static constexpr size_t num_buckets = 12;
+
+    uint32_t count = 0;
+    uint32_t min = 0;
+    uint32_t max = 0;
+    float mean = 0.0f;
+    uint32_t histogram[num_buckets] = {};
+
+    __RAM_FUNC void record(uint32_t cycles) {
+        if (count == 0 || cycles < min)
+            min = cycles;
+        if (cycles > max)
+            max = cycles;
+        ++count;
+        mean += ((float)cycles - mean) / (float)count;
+        int bucket = 31 - __builtin_clz(cycles | 1) - 6;
+        bucket = std::min(std::max(bucket, 0), (int)num_buckets - 1);
+        ++histogram[bucket];
+    }
+
+    auto make_protocol_definitions() {
+        static_assert(num_buckets == 12, "update the protocol definitions below");
+        return make_protocol_member_list(
+            make_protocol_ro_property("count", &count),
+            make_protocol_ro_property("min", &min),
+            make_protocol_ro_property("max", &max),
+            make_protocol_ro_property("mean", &mean),
+            make_protocol_ro_property("hist_0", &histogram[0]),
+            make_protocol_ro_property("hist_1", &histogram[1]),
+            make_protocol_ro_property("hist_2", &histogram[2]),
+            make_protocol_ro_property("hist_3", &histogram[3]),
+            make_protocol_ro_property("hist_4", &histogram[4]),
+            make_protocol_ro_property("hist_5", &histogram[5]),
+            make_protocol_ro_property("hist_6", &histogram[6]),
+            make_protocol_ro_property("hist_7", &histogram[7]),
+            make_protocol_ro_property("hist_8", &histogram[8]),
+            make_protocol_ro_property("hist_9", &histogram[9]),
+            make_protocol_ro_property("hist_10", &histogram[10]),
+            make_protocol_ro_property("hist_11", &histogram[11])
+        );
+    }
+};
+
+// @brief Cycle accurate execution time statistics of the interrupt and the
+// control loop of one axis.
+//
+// All slots are in CPU cycles (168MHz). ISR_ENTRY is the time of the current
+// measurement interrupt relative to the start of the control period (same
+// reference as the timing log), converted from TIM13 counts to CPU cycles
+// (see timing_cycles_now). CONTROL_LOOP is the time from the current
+// measurement interrupt until the control loop iteration that handles it is
+// done, i.e. the deadline margin is the control period minus its max.
+// PREEMPTION is the part of CONTROL_LOOP that was not spent in one of the
+// profiled control stages: interrupts (comms, the other axis), other threads
+// and the unprofiled glue code of the loop.
+class Profiler {
+public:
+    static constexpr uint32_t cpu_clock_hz = 168000000; // HCLK, see SystemClock_Config()
+
+    enum Slot_t {
+        SLOT_ISR_ENTRY,
+        SLOT_CURRENT_MEAS_CB,
+        SLOT_FOC,
+        SLOT_CHECKS,
+        SLOT_ESTIMATORS,
+        SLOT_CONTROLLER,
+        SLOT_CURRENT_CONTROL,
+        SLOT_CONTROL_LOOP,
+        SLOT_PREEMPTION,
+        NUM_SLOTS
+    };
+
+    // @brief Records a sample from the current measurement interrupt.
+    __RAM_FUNC void record_from_isr(Slot_t slot, uint32_t cycles) {
+        slots_[slot].record(cycles);
+    }
+
+    // @brief Records a sample from thread context.
+    // The interrupt records SLOT_FOC too (current_control_in_isr) and reset()
+    // clears all slots, so the update of the slot must not be interrupted.
+    void record(Slot_t slot, uint32_t cycles) {
+        uint32_t mask = cpu_enter_critical();
+        slots_[slot].record(cycles);
+        cpu_exit_critical(mask);
+    }
+
+    // @brief Records the execution time of a control stage that started at
+    // the given cycle count and adds it to the time of the current iteration.
+    void record_stage(Slot_t slot, uint32_t start) {
+        uint32_t cycles = cycles_now() - start;
+        record(slot, cycles);
+        stage_cycles_ += cycles;
+    }
+
+    // Called by the current measurement interrupt
+    __RAM_FUNC void current_meas_done() {
+        current_meas_cycles_ = cycles_now();
+    }
+
+    // Called by the control loop after it woke up on a current measurement
+    void start_iteration() {
+        iteration_valid_ = true;
+        stage_cycles_ = 0;
+    }
+
+    // Called by the control loop when the iteration is done
+    void end_iteration() {
+        if (iteration_valid_) {
+            uint32_t cycles = cycles_now() - current_meas_cycles_;
+            record(SLOT_CONTROL_LOOP, cycles);
+            record(SLOT_PREEMPTION, cycles > stage_cycles_ ? cycles - stage_cycles_ : 0);
+        }
+        iteration_valid_ = false;
+        stage_cycles_ = 0;
+    }
+
+    // @brief Clears all slots. Called from the communication threads.
+    void reset() {
+        uint32_t mask = cpu_enter_critical();
+        for (ProfilerSlot_t& slot : slots_)
+            slot = ProfilerSlot_t();
+        cpu_exit_critical(mask);
+    }
+
+    ProfilerSlot_t slots_[NUM_SLOTS];
+    volatile uint32_t current_meas_cycles_ = 0;
+    uint32_t stage_cycles_ = 0;
+    bool iteration_valid_ = false;
+
+    auto make_protocol_definitions() {
+        return make_protocol_member_list(
+            make_protocol_object("isr_entry", slots_[SLOT_ISR_ENTRY].make_protocol_definitions()),
+            make_protocol_object("current_meas_cb", slots_[SLOT_CURRENT_MEAS_CB].make_protocol_definitions()),
+            make_protocol_object("foc", slots_[SLOT_FOC].make_protocol_definitions()),
+            make_protocol_object("checks", slots_[SLOT_CHECKS].make_protocol_definitions()),
+            make_protocol_object("estimators", slots_[SLOT_ESTIMATORS].make_protocol_definitions()),
+            make_protocol_object("controller", slots_[SLOT_CONTROLLER].make_protocol_definitions()),
+            make_protocol_object("current_control", slots_[SLOT_CURRENT_CONTROL].make_protocol_definitions()),
+            make_protocol_object("control_loop", slots_[SLOT_CONTROL_LOOP].make_protocol_definitions()),
+            make_protocol_object("preemption", slots_[SLOT_PREEMPTION].make_protocol_definitions()),
+            make_protocol_function("reset", *this, &Profiler::reset)
+        );
+    }
+};
+
+#endif // __PROFILER_HPP
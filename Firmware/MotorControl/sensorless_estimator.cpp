@@ -3,7 +3,26 @@
 
 SensorlessEstimator::SensorlessEstimator(Config_t& config) :
         config_(config)
-    {};
+    {
+        update_pll_gains();
+    };
+
+// Pll gains as a function of bandwidth
+void SensorlessEstimator::update_pll_gains() {
+    pll_kp_ = 2.0f * config_.pll_bandwidth;
+    // Critically damped
+    pll_ki_ = 0.25f * (pll_kp_ * pll_kp_);
+
+    // Check that we don't get problems with discrete time approximation
+    if (!(current_meas_period * pll_kp_ < 1.0f)) {
+        error_ |= ERROR_UNSTABLE_GAIN;
+    }
+}
+
+void SensorlessEstimator::invalidate_derived_params() {
+    if (axis_)
+        axis_->invalidate_derived_params();
+}
 
 bool SensorlessEstimator::update() {
     // Algorithm based on paper: Sensorless Control of Surface-Mount Permanent-Magnet Synchronous Motors Based on a Nonlinear Observer
@@ -22,11 +41,14 @@ bool SensorlessEstimator::update() {
     // Swap sign of I_beta if motor is reversed
     I_alpha_beta[1] *= axis_->motor_.config_.direction;
 
+    // Follows the online estimate if resistance estimation is enabled
+    float phase_resistance = axis_->motor_.effective_phase_resistance();
+
     // alpha-beta vector operations
     float eta[2];
     for (int i = 0; i <= 1; ++i) {
         // y is the total flux-driving voltage (see paper eqn 4)
-        float y = -axis_->motor_.config_.phase_resistance * I_alpha_beta[i] + V_alpha_beta_memory_[i];
+        float y = -phase_resistance * I_alpha_beta[i] + V_alpha_beta_memory_[i];
         // flux dynamics (prediction)
         float x_dot = y;
         // integrate prediction to current timestep
@@ -58,24 +80,18 @@ bool SensorlessEstimator::update() {
 
     // PLL
     // TODO: the PLL part has some code duplication with the encoder PLL
-    // Pll gains as a function of bandwidth
-    float pll_kp = 2.0f * config_.pll_bandwidth;
-    // Critically damped
-    float pll_ki = 0.25f * (pll_kp * pll_kp);
-    // Check that we don't get problems with discrete time approximation
-    if (!(current_meas_period * pll_kp < 1.0f)) {
-        error_ |= ERROR_UNSTABLE_GAIN;
+    // The gains were checked by update_pll_gains
+    if (error_ & ERROR_UNSTABLE_GAIN)
         return false;
-    }
 
     // predict PLL phase with velocity
     pll_pos_ = wrap_pm_pi(pll_pos_ + current_meas_period * vel_estimate_);
     // update PLL phase with observer permanent magnet phase
     phase_ = fast_atan2(eta[1], eta[0]);
     float delta_phase = wrap_pm_pi(phase_ - pll_pos_);
-    pll_pos_ = wrap_pm_pi(pll_pos_ + current_meas_period * pll_kp * delta_phase);
+    pll_pos_ = wrap_pm_pi(pll_pos_ + current_meas_period * pll_kp_ * delta_phase);
     // update PLL velocity
-    vel_estimate_ += current_meas_period * pll_ki * delta_phase;
+    vel_estimate_ += current_meas_period * pll_ki_ * delta_phase;
 
     return true;
 };
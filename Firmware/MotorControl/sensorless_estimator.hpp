@@ -17,6 +17,8 @@ public:
     explicit SensorlessEstimator(Config_t& config);
 
     bool update();
+    void update_pll_gains();
+    void invalidate_derived_params();
 
     Axis* axis_ = nullptr; // set by Axis constructor
     Config_t& config_;
@@ -26,8 +28,8 @@ public:
     float phase_ = 0.0f;                        // [rad]
     float pll_pos_ = 0.0f;                      // [rad]
     float vel_estimate_ = 0.0f;                      // [rad/s]
-    // float pll_kp_ = 0.0f;                       // [rad/s / rad]
-    // float pll_ki_ = 0.0f;                       // [(rad/s^2) / rad]
+    float pll_kp_ = 0.0f;                       // [rad/s / rad]
+    float pll_ki_ = 0.0f;                       // [(rad/s^2) / rad]
     float flux_state_[2] = {0.0f, 0.0f};        // [Vs]
     float V_alpha_beta_memory_[2] = {0.0f, 0.0f}; // [V]
     bool estimator_good_ = false;
@@ -35,7 +37,9 @@ public:
     // Communication protocol definitions
     auto make_protocol_definitions() {
         return make_protocol_member_list(
-            make_protocol_property("error", &error_),
+            // Clearing the error re-runs the gain check in update_pll_gains
+            make_protocol_property("error", &error_,
+                [](void* ctx) { static_cast<SensorlessEstimator*>(ctx)->invalidate_derived_params(); }, this),
             make_protocol_property("phase", &phase_),
             make_protocol_property("pll_pos", &pll_pos_),
             make_protocol_property("vel_estimate", &vel_estimate_),
@@ -43,7 +47,8 @@ public:
             // make_protocol_property("pll_ki", &pll_ki_),
             make_protocol_object("config",
                 make_protocol_property("observer_gain", &config_.observer_gain),
-                make_protocol_property("pll_bandwidth", &config_.pll_bandwidth),
+                make_protocol_property("pll_bandwidth", &config_.pll_bandwidth,
+                    [](void* ctx) { static_cast<SensorlessEstimator*>(ctx)->invalidate_derived_params(); }, this),
                 make_protocol_property("pm_flux_linkage", &config_.pm_flux_linkage)
             )
         );
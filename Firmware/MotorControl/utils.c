@@ -6,160 +6,32 @@
 #include <stm32f4xx_hal.h>
 
 
-int SVM(float alpha, float beta, float* tA, float* tB, float* tC) {
-    int Sextant;
-
-    if (beta >= 0.0f) {
-        if (alpha >= 0.0f) {
-            //quadrant I
-            if (one_by_sqrt3 * beta > alpha)
-                Sextant = 2; //sextant v2-v3
-            else
-                Sextant = 1; //sextant v1-v2
-
-        } else {
-            //quadrant II
-            if (-one_by_sqrt3 * beta > alpha)
-                Sextant = 3; //sextant v3-v4
-            else
-                Sextant = 2; //sextant v2-v3
-        }
-    } else {
-        if (alpha >= 0.0f) {
-            //quadrant IV
-            if (-one_by_sqrt3 * beta > alpha)
-                Sextant = 5; //sextant v5-v6
-            else
-                Sextant = 6; //sextant v6-v1
-        } else {
-            //quadrant III
-            if (one_by_sqrt3 * beta > alpha)
-                Sextant = 4; //sextant v4-v5
-            else
-                Sextant = 5; //sextant v5-v6
-        }
-    }
-
-    switch (Sextant) {
-        // sextant v1-v2
-        case 1: {
-            // Vector on-times
-            float t1 = alpha - one_by_sqrt3 * beta;
-            float t2 = two_by_sqrt3 * beta;
-
-            // PWM timings
-            *tA = (1.0f - t1 - t2) * 0.5f;
-            *tB = *tA + t1;
-            *tC = *tB + t2;
-        } break;
-
-        // sextant v2-v3
-        case 2: {
-            // Vector on-times
-            float t2 = alpha + one_by_sqrt3 * beta;
-            float t3 = -alpha + one_by_sqrt3 * beta;
-
-            // PWM timings
-            *tB = (1.0f - t2 - t3) * 0.5f;
-            *tA = *tB + t3;
-            *tC = *tA + t2;
-        } break;
-
-        // sextant v3-v4
-        case 3: {
-            // Vector on-times
-            float t3 = two_by_sqrt3 * beta;
-            float t4 = -alpha - one_by_sqrt3 * beta;
-
-            // PWM timings
-            *tB = (1.0f - t3 - t4) * 0.5f;
-            *tC = *tB + t3;
-            *tA = *tC + t4;
-        } break;
-
-        // sextant v4-v5
-        case 4: {
-            // Vector on-times
-            float t4 = -alpha + one_by_sqrt3 * beta;
-            float t5 = -two_by_sqrt3 * beta;
-
-            // PWM timings
-            *tC = (1.0f - t4 - t5) * 0.5f;
-            *tB = *tC + t5;
-            *tA = *tB + t4;
-        } break;
-
-        // sextant v5-v6
-        case 5: {
-            // Vector on-times
-            float t5 = -alpha - one_by_sqrt3 * beta;
-            float t6 = alpha - one_by_sqrt3 * beta;
-
-            // PWM timings
-            *tC = (1.0f - t5 - t6) * 0.5f;
-            *tA = *tC + t5;
-            *tB = *tA + t6;
-        } break;
-
-        // sextant v6-v1
-        case 6: {
-            // Vector on-times
-            float t6 = -two_by_sqrt3 * beta;
-            float t1 = alpha + one_by_sqrt3 * beta;
-
-            // PWM timings
-            *tA = (1.0f - t6 - t1) * 0.5f;
-            *tC = *tA + t1;
-            *tB = *tC + t6;
-        } break;
-    }
-
-    // if any of the results becomes NaN, result_valid will evaluate to false
-    int result_valid =
-            *tA >= 0.0f && *tA <= 1.0f
-         && *tB >= 0.0f && *tB <= 1.0f
-         && *tC >= 0.0f && *tC <= 1.0f;
-    return result_valid ? 0 : -1;
-}
-
-// based on https://math.stackexchange.com/a/1105038/81278
-float fast_atan2(float y, float x) {
-    // a := min (|x|, |y|) / max (|x|, |y|)
-    float abs_y = fabsf(y);
-    float abs_x = fabsf(x);
-    // inject FLT_MIN in denominator to avoid division by zero
-    float a = MACRO_MIN(abs_x, abs_y) / (MACRO_MAX(abs_x, abs_y) + FLT_MIN);
-    // s := a * a
-    float s = a * a;
-    // r := ((-0.0464964749 * s + 0.15931422) * s - 0.327622764) * s * a + a
-    float r = ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
-    // if |y| > |x| then r := 1.57079637 - r
-    if (abs_y > abs_x)
-        r = 1.57079637f - r;
-    // if x < 0 then r := 3.14159274 - r
-    if (x < 0.0f)
-        r = 3.14159274f - r;
-    // if y < 0 then r := -r
-    if (y < 0.0f)
-        r = -r;
-
-    return r;
-}
-
-// Evaluate polynomials using Fused Multiply Add intrisic instruction.
-// coeffs[0] is highest order, as per numpy.polyfit
-// p(x) = coeffs[0] * x^deg + ... + coeffs[deg], for some degree "deg"
-float horner_fma(float x, const float *coeffs, size_t count) {
-    float result = 0.0f;
-    for (int idx = 0; idx < count; ++idx)
-        result = fmaf(result, x, coeffs[idx]);
-    return result;
-}
-
-// Modulo (as opposed to remainder), per https://stackoverflow.com/a/19288271
-int mod(int dividend, int divisor){
-    int r = dividend % divisor;
-    return (r < 0) ? (r + divisor) : r;
+// Space vector modulation by min/max common mode injection.
+// The phase voltages of the inverse Clarke transform are shifted so that the
+// highest and the lowest phase are centered in the PWM period. This is the
+// same as splitting the zero vector time equally between v0 and v7 in the
+// sextant formulation, but costs the same for every input.
+// The timings are inverted (a higher phase voltage gives a lower value).
+// Returns -1 if the vector does not fit into the SVM hexagon or is NaN.
+__RAM_FUNC int SVM(float alpha, float beta, float* tA, float* tB, float* tC) {
+    // Phase voltages, scaled such that a difference of 1 spans one PWM period
+    float vA = (2.0f / 3.0f) * alpha;
+    float vB = -(1.0f / 3.0f) * alpha + one_by_sqrt3 * beta;
+    float vC = -(1.0f / 3.0f) * alpha - one_by_sqrt3 * beta;
+
+    // NaN inputs make vB and vC (beta) or all phases (alpha) NaN. The outer
+    // comparison then fails, so v_max and v_min are NaN as well.
+    float v_max = MACRO_MAX(vA, MACRO_MAX(vB, vC));
+    float v_min = MACRO_MIN(vA, MACRO_MIN(vB, vC));
+    float center = 0.5f + 0.5f * (v_max + v_min);
+
+    *tA = center - vA;
+    *tB = center - vB;
+    *tC = center - vC;
+
+    // All timings are within [0, 1] if the spread of the phases fits into
+    // one period. A NaN fails the comparison.
+    return (v_max - v_min <= 1.0f) ? 0 : -1;
 }
 
 // @brief: Returns how much time is left until the deadline is reached.
@@ -0,0 +1,20 @@
+/*
+* Host-side stand-in for the CMSIS DSP lookup table header.
+* The tables are generated at startup by sim_init_tables() in sim_hal.cpp.
+*/
+#ifndef __SIM_ARM_COMMON_TABLES_H
+#define __SIM_ARM_COMMON_TABLES_H
+
+#include "arm_math.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern float32_t sinTable_f32[FAST_MATH_TABLE_SIZE + 1];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SIM_ARM_COMMON_TABLES_H */
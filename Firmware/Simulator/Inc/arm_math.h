@@ -0,0 +1,26 @@
+/*
+* Host-side stand-in for the CMSIS DSP library header.
+* Only provides the types and constants used by the motor control code.
+*/
+#ifndef __SIM_ARM_MATH_H
+#define __SIM_ARM_MATH_H
+
+#include <stdint.h>
+#include <math.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef float float32_t;
+typedef int32_t q31_t;
+typedef int16_t q15_t;
+
+#define FAST_MATH_TABLE_SIZE 512
+#define PI 3.14159265358979f
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SIM_ARM_MATH_H */
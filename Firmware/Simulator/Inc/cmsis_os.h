@@ -0,0 +1,89 @@
+/*
+* Host-side stand-in for the CMSIS-RTOS API on top of FreeRTOS.
+*
+* Threads are backed by host threads, but only one of them (or the
+* simulated interrupt context) runs at any given time. Time only advances
+* while all threads are blocked, which makes every simulation run
+* deterministic. See Simulator/sim_rtos.cpp.
+*/
+#ifndef __SIM_CMSIS_OS_H
+#define __SIM_CMSIS_OS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define osKernelSysTickFrequency 1000
+
+typedef enum {
+    osPriorityIdle          = -3,
+    osPriorityLow           = -2,
+    osPriorityBelowNormal   = -1,
+    osPriorityNormal        =  0,
+    osPriorityAboveNormal   = +1,
+    osPriorityHigh          = +2,
+    osPriorityRealtime      = +3,
+    osPriorityError         =  0x84
+} osPriority;
+
+#define osWaitForever 0xFFFFFFFFU
+
+typedef enum {
+    osOK                    =     0,
+    osEventSignal           =  0x08,
+    osEventMessage          =  0x10,
+    osEventMail             =  0x20,
+    osEventTimeout          =  0x40,
+    osErrorParameter        =  0x80,
+    osErrorResource         =  0x81,
+    osErrorTimeoutResource  =  0xC1,
+    osErrorISR              =  0x82,
+    osErrorISRRecursive     =  0x83,
+    osErrorPriority         =  0x84,
+    osErrorNoMemory         =  0x85,
+    osErrorValue            =  0x86,
+    osErrorOS               =  0xFF,
+    os_status_reserved      =  0x7FFFFFFF
+} osStatus;
+
+typedef void (*os_pthread)(void const* argument);
+typedef struct SimThread* osThreadId;
+
+typedef struct os_thread_def {
+    const char* name;
+    os_pthread pthread;
+    osPriority tpriority;
+    uint32_t instances;
+    uint32_t stacksize;
+} osThreadDef_t;
+
+typedef struct {
+    osStatus status;
+    union {
+        uint32_t v;
+        void* p;
+        int32_t signals;
+    } value;
+} osEvent;
+
+#define osThreadDef(name, thread, priority, instances, stacksz) \
+const osThreadDef_t os_thread_def_##name = \
+{ #name, (os_pthread)(thread), (priority), (instances), (stacksz) }
+
+#define osThread(name) &os_thread_def_##name
+
+osThreadId osThreadCreate(const osThreadDef_t* thread_def, void* argument);
+osThreadId osThreadGetId(void);
+osStatus osDelay(uint32_t millisec);
+int32_t osSignalSet(osThreadId thread_id, int32_t signals);
+osEvent osSignalWait(int32_t signals, uint32_t millisec);
+uint32_t osKernelSysTick(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SIM_CMSIS_OS_H */
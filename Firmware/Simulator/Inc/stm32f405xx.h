@@ -0,0 +1,201 @@
+/*
+* Host-side stand-in for the CMSIS device header of the STM32F405.
+*
+* Only the peripherals and register bits that the motor control code touches
+* are modelled. The register blocks are plain structs in host memory which
+* are read and written by the simulator (see Simulator/simulator.cpp).
+* Field names and bit positions match the real device header so that
+* MotorControl/ compiles unmodified.
+*/
+#ifndef __SIM_STM32F405XX_H
+#define __SIM_STM32F405XX_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define __IO volatile
+#define __I volatile const
+
+typedef struct {
+    __IO uint32_t MODER;
+    __IO uint32_t OTYPER;
+    __IO uint32_t OSPEEDR;
+    __IO uint32_t PUPDR;
+    __IO uint32_t IDR;
+    __IO uint32_t ODR;
+    __IO uint32_t BSRR;
+    __IO uint32_t LCKR;
+    __IO uint32_t AFR[2];
+} GPIO_TypeDef;
+
+typedef struct {
+    __IO uint32_t CR1;
+    __IO uint32_t CR2;
+    __IO uint32_t SMCR;
+    __IO uint32_t DIER;
+    __IO uint32_t SR;
+    __IO uint32_t EGR;
+    __IO uint32_t CCMR1;
+    __IO uint32_t CCMR2;
+    __IO uint32_t CCER;
+    __IO uint32_t CNT;
+    __IO uint32_t PSC;
+    __IO uint32_t ARR;
+    __IO uint32_t RCR;
+    __IO uint32_t CCR1;
+    __IO uint32_t CCR2;
+    __IO uint32_t CCR3;
+    __IO uint32_t CCR4;
+    __IO uint32_t BDTR;
+    __IO uint32_t DCR;
+    __IO uint32_t DMAR;
+    __IO uint32_t OR;
+} TIM_TypeDef;
+
+typedef struct {
+    __IO uint32_t SR;
+    __IO uint32_t CR1;
+    __IO uint32_t CR2;
+    __IO uint32_t SMPR1;
+    __IO uint32_t SMPR2;
+    __IO uint32_t JOFR1;
+    __IO uint32_t JOFR2;
+    __IO uint32_t JOFR3;
+    __IO uint32_t JOFR4;
+    __IO uint32_t HTR;
+    __IO uint32_t LTR;
+    __IO uint32_t SQR1;
+    __IO uint32_t SQR2;
+    __IO uint32_t SQR3;
+    __IO uint32_t JSQR;
+    __IO uint32_t JDR1;
+    __IO uint32_t JDR2;
+    __IO uint32_t JDR3;
+    __IO uint32_t JDR4;
+    __IO uint32_t DR;
+} ADC_TypeDef;
+
+typedef struct {
+    __IO uint32_t CSR;
+    __IO uint32_t CCR;
+    __IO uint32_t CDR;
+} ADC_Common_TypeDef;
+
+typedef struct {
+    __IO uint32_t CR;
+    __IO uint32_t NDTR;
+    __IO uint32_t PAR;
+    __IO uint32_t M0AR;
+    __IO uint32_t M1AR;
+    __IO uint32_t FCR;
+} DMA_Stream_TypeDef;
+
+typedef struct {
+    __IO uint32_t DHCSR;
+    __IO uint32_t DCRSR;
+    __IO uint32_t DCRDR;
+    __IO uint32_t DEMCR;
+} CoreDebug_Type;
+
+typedef struct {
+    __IO uint32_t CTRL;
+    __IO uint32_t CYCCNT;
+} DWT_Type;
+
+// Register files of the simulated peripherals (defined in sim_hal.cpp)
+extern GPIO_TypeDef sim_GPIOA, sim_GPIOB, sim_GPIOC, sim_GPIOD;
+extern TIM_TypeDef sim_TIM1, sim_TIM2, sim_TIM3, sim_TIM4, sim_TIM5, sim_TIM8, sim_TIM13;
+extern ADC_TypeDef sim_ADC1, sim_ADC2, sim_ADC3;
+extern ADC_Common_TypeDef sim_ADC123_COMMON;
+extern DMA_Stream_TypeDef sim_DMA2_Stream[8];
+extern CoreDebug_Type sim_CoreDebug;
+extern DWT_Type sim_DWT;
+TIM_TypeDef* sim_time_base_timer(void);
+DWT_Type* sim_cycle_counter(void);
+
+#define GPIOA (&sim_GPIOA)
+#define GPIOB (&sim_GPIOB)
+#define GPIOC (&sim_GPIOC)
+#define GPIOD (&sim_GPIOD)
+#define TIM1 (&sim_TIM1)
+#define TIM2 (&sim_TIM2)
+#define TIM3 (&sim_TIM3)
+#define TIM4 (&sim_TIM4)
+#define TIM5 (&sim_TIM5)
+#define TIM8 (&sim_TIM8)
+#define TIM13 (&sim_TIM13)
+// TIM14 is the microsecond time base used by micros(). Reading it through a
+// function lets busy-wait loops make progress on the host.
+#define TIM14 (sim_time_base_timer())
+#define ADC1 (&sim_ADC1)
+#define ADC2 (&sim_ADC2)
+#define ADC3 (&sim_ADC3)
+#define ADC123_COMMON (&sim_ADC123_COMMON)
+#define DMA2_Stream0 (&sim_DMA2_Stream[0])
+#define DMA2_Stream1 (&sim_DMA2_Stream[1])
+#define DMA2_Stream2 (&sim_DMA2_Stream[2])
+#define DMA2_Stream3 (&sim_DMA2_Stream[3])
+#define DMA2_Stream4 (&sim_DMA2_Stream[4])
+#define DMA2_Stream5 (&sim_DMA2_Stream[5])
+#define DMA2_Stream6 (&sim_DMA2_Stream[6])
+#define DMA2_Stream7 (&sim_DMA2_Stream[7])
+#define CoreDebug (&sim_CoreDebug)
+// The DWT cycle counter follows the host clock (scaled to 168MHz), so
+// that the profiler measures the host execution time of the firmware.
+#define DWT (sim_cycle_counter())
+
+/* TIM register bits */
+#define TIM_CR1_CEN         (0x1U << 0)
+#define TIM_CR1_UDIS        (0x1U << 1)
+#define TIM_CR1_DIR         (0x1U << 4)
+#define TIM_CR1_CMS         (0x3U << 5)
+#define TIM_CR1_ARPE        (0x1U << 7)
+#define TIM_CR2_CCDS        (0x1U << 3)
+#define TIM_CR2_MMS         (0x7U << 4)
+#define TIM_SMCR_SMS        (0x7U << 0)
+#define TIM_SMCR_TS         (0x7U << 4)
+#define TIM_DIER_UIE        (0x1U << 0)
+#define TIM_DIER_UDE        (0x1U << 8)
+#define TIM_DIER_CC1DE      (0x1U << 9)
+#define TIM_DIER_CC2DE      (0x1U << 10)
+#define TIM_DIER_CC3DE      (0x1U << 11)
+#define TIM_DIER_CC4DE      (0x1U << 12)
+#define TIM_SR_UIF          (0x1U << 0)
+#define TIM_EGR_UG          (0x1U << 0)
+#define TIM_BDTR_MOE        (0x1U << 15)
+
+/* ADC register bits */
+#define ADC_SR_AWD          (0x1U << 0)
+#define ADC_SR_EOC          (0x1U << 1)
+#define ADC_SR_JEOC         (0x1U << 2)
+#define ADC_SR_JSTRT        (0x1U << 3)
+#define ADC_SR_STRT         (0x1U << 4)
+#define ADC_SR_OVR          (0x1U << 5)
+#define ADC_CR1_AWDCH_Pos   (0U)
+#define ADC_CR1_EOCIE       (0x1U << 5)
+#define ADC_CR1_JEOCIE      (0x1U << 7)
+#define ADC_CR2_ADON        (0x1U << 0)
+
+/* DMA register bits */
+#define DMA_SxCR_EN         (0x1U << 0)
+#define DMA_SxCR_DIR        (0x3U << 6)
+#define DMA_SxCR_CIRC       (0x1U << 8)
+#define DMA_SxCR_PINC       (0x1U << 9)
+#define DMA_SxCR_MINC       (0x1U << 10)
+#define DMA_SxCR_PSIZE      (0x3U << 11)
+#define DMA_SxCR_MSIZE      (0x3U << 13)
+#define DMA_SxCR_PL         (0x3U << 16)
+#define DMA_SxCR_CHSEL      (0x7U << 25)
+
+/* Debug register bits */
+#define CoreDebug_DEMCR_TRCENA_Msk  (0x1U << 24)
+#define DWT_CTRL_CYCCNTENA_Msk      (0x1U << 0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SIM_STM32F405XX_H */
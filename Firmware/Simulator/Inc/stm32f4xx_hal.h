@@ -0,0 +1,277 @@
+/*
+* Host-side stand-in for the STM32F4 HAL.
+*
+* Declares the subset of the HAL types, macros and functions that the motor
+* control code uses. The functions are implemented in Simulator/sim_hal.cpp
+* on top of the simulated register files in stm32f405xx.h.
+*/
+#ifndef __SIM_STM32F4XX_HAL_H
+#define __SIM_STM32F4XX_HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "stm32f405xx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef __weak
+#define __weak __attribute__((weak))
+#endif
+#ifndef __packed
+#define __packed __attribute__((__packed__))
+#endif
+#define __ASM __asm__
+// Code placement in RAM has no meaning on the host
+#define __RAM_FUNC
+
+typedef enum {
+    HAL_OK = 0x00U,
+    HAL_ERROR = 0x01U,
+    HAL_BUSY = 0x02U,
+    HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+typedef enum { DISABLE = 0U, ENABLE = !DISABLE } FunctionalState;
+
+/* Core ----------------------------------------------------------------------*/
+
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+static inline void __set_PRIMASK(uint32_t priMask) { (void)priMask; }
+static inline void __disable_irq(void) {}
+static inline void __enable_irq(void) {}
+void NVIC_SystemReset(void);
+uint32_t HAL_GetTick(void);
+
+#define __HAL_DBGMCU_FREEZE_TIM1() ((void)0)
+#define __HAL_DBGMCU_FREEZE_TIM8() ((void)0)
+
+/* GPIO ----------------------------------------------------------------------*/
+
+typedef enum { GPIO_PIN_RESET = 0, GPIO_PIN_SET } GPIO_PinState;
+
+typedef struct {
+    uint32_t Pin;
+    uint32_t Mode;
+    uint32_t Pull;
+    uint32_t Speed;
+    uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+#define GPIO_PIN_0  ((uint16_t)0x0001)
+#define GPIO_PIN_1  ((uint16_t)0x0002)
+#define GPIO_PIN_2  ((uint16_t)0x0004)
+#define GPIO_PIN_3  ((uint16_t)0x0008)
+#define GPIO_PIN_4  ((uint16_t)0x0010)
+#define GPIO_PIN_5  ((uint16_t)0x0020)
+#define GPIO_PIN_6  ((uint16_t)0x0040)
+#define GPIO_PIN_7  ((uint16_t)0x0080)
+#define GPIO_PIN_8  ((uint16_t)0x0100)
+#define GPIO_PIN_9  ((uint16_t)0x0200)
+#define GPIO_PIN_10 ((uint16_t)0x0400)
+#define GPIO_PIN_11 ((uint16_t)0x0800)
+#define GPIO_PIN_12 ((uint16_t)0x1000)
+#define GPIO_PIN_13 ((uint16_t)0x2000)
+#define GPIO_PIN_14 ((uint16_t)0x4000)
+#define GPIO_PIN_15 ((uint16_t)0x8000)
+
+#define GPIO_MODE_INPUT         0x00000000U
+#define GPIO_MODE_OUTPUT_PP     0x00000001U
+#define GPIO_MODE_AF_PP         0x00000002U
+#define GPIO_MODE_ANALOG        0x00000003U
+#define GPIO_MODE_IT_RISING     0x10110000U
+#define GPIO_NOPULL             0x00000000U
+#define GPIO_PULLUP             0x00000001U
+#define GPIO_PULLDOWN           0x00000002U
+#define GPIO_SPEED_FREQ_LOW     0x00000000U
+#define GPIO_AF2_TIM5           ((uint8_t)0x02)
+
+void HAL_GPIO_Init(GPIO_TypeDef* GPIOx, GPIO_InitTypeDef* GPIO_Init);
+void HAL_GPIO_DeInit(GPIO_TypeDef* GPIOx, uint32_t GPIO_Pin);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+
+/* DMA -----------------------------------------------------------------------*/
+
+typedef struct {
+    uint32_t Channel;
+    uint32_t Direction;
+    uint32_t PeriphInc;
+    uint32_t MemInc;
+    uint32_t PeriphDataAlignment;
+    uint32_t MemDataAlignment;
+    uint32_t Mode;
+    uint32_t Priority;
+    uint32_t FIFOMode;
+} DMA_InitTypeDef;
+
+typedef struct {
+    DMA_Stream_TypeDef* Instance;
+    DMA_InitTypeDef Init;
+} DMA_HandleTypeDef;
+
+#define DMA_CHANNEL_6                       0x0C000000U
+#define DMA_CHANNEL_7                       0x0E000000U
+#define DMA_PERIPH_TO_MEMORY                0x00000000U
+#define DMA_PINC_DISABLE                    0x00000000U
+#define DMA_MINC_DISABLE                    0x00000000U
+#define DMA_PDATAALIGN_HALFWORD             0x00000800U
+#define DMA_PDATAALIGN_WORD                 0x00001000U
+#define DMA_MDATAALIGN_HALFWORD             0x00002000U
+#define DMA_MDATAALIGN_WORD                 0x00004000U
+#define DMA_CIRCULAR                        DMA_SxCR_CIRC
+#define DMA_PRIORITY_VERY_HIGH              DMA_SxCR_PL
+#define DMA_FIFOMODE_DISABLE                0x00000000U
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef* hdma);
+// The addresses are host pointers here, hence uintptr_t instead of uint32_t
+HAL_StatusTypeDef HAL_DMA_Start(DMA_HandleTypeDef* hdma, uintptr_t SrcAddress, uintptr_t DstAddress, uint32_t DataLength);
+
+/* TIM -----------------------------------------------------------------------*/
+
+typedef struct {
+    uint32_t Prescaler;
+    uint32_t CounterMode;
+    uint32_t Period;
+    uint32_t ClockDivision;
+    uint32_t RepetitionCounter;
+} TIM_Base_InitTypeDef;
+
+typedef struct {
+    uint32_t ICPolarity;
+    uint32_t ICSelection;
+    uint32_t ICPrescaler;
+    uint32_t ICFilter;
+} TIM_IC_InitTypeDef;
+
+typedef struct {
+    TIM_TypeDef* Instance;
+    TIM_Base_InitTypeDef Init;
+    DMA_HandleTypeDef* hdma[7];
+} TIM_HandleTypeDef;
+
+#define TIM_CHANNEL_1                       0x00000000U
+#define TIM_CHANNEL_2                       0x00000004U
+#define TIM_CHANNEL_3                       0x00000008U
+#define TIM_CHANNEL_4                       0x0000000CU
+#define TIM_CHANNEL_ALL                     0x00000018U
+#define TIM_IT_UPDATE                       TIM_DIER_UIE
+#define TIM_DMA_UPDATE                      TIM_DIER_UDE
+#define TIM_DMA_CC1                         TIM_DIER_CC1DE
+#define TIM_DMA_CC2                         TIM_DIER_CC2DE
+#define TIM_DMA_CC3                         TIM_DIER_CC3DE
+#define TIM_DMA_CC4                         TIM_DIER_CC4DE
+#define TIM_FLAG_UPDATE                     TIM_SR_UIF
+#define TIM_TRGO_ENABLE                     (0x1U << 4)
+#define TIM_TRGO_UPDATE                     (0x2U << 4)
+#define TIM_CLOCKSOURCE_ITR0                0x00000000U
+#define TIM_SLAVEMODE_TRIGGER               0x00000006U
+#define TIM_COUNTERMODE_UP                  0x00000000U
+#define TIM_COUNTERMODE_CENTERALIGNED3      TIM_CR1_CMS
+#define TIM_INPUTCHANNELPOLARITY_BOTHEDGE   0x0000000AU
+#define TIM_ICSELECTION_DIRECTTI            0x00000001U
+#define TIM_ICPSC_DIV1                      0x00000000U
+
+#define __HAL_TIM_MOE_ENABLE(__HANDLE__) ((__HANDLE__)->Instance->BDTR |= (TIM_BDTR_MOE))
+#define __HAL_TIM_MOE_DISABLE_UNCONDITIONALLY(__HANDLE__) ((__HANDLE__)->Instance->BDTR &= ~(TIM_BDTR_MOE))
+#define __HAL_TIM_SET_AUTORELOAD(__HANDLE__, __AUTORELOAD__) \
+    do { (__HANDLE__)->Instance->ARR = (__AUTORELOAD__); (__HANDLE__)->Init.Period = (__AUTORELOAD__); } while (0)
+#define __HAL_TIM_ENABLE_IT(__HANDLE__, __INTERRUPT__) ((__HANDLE__)->Instance->DIER |= (__INTERRUPT__))
+#define __HAL_TIM_DISABLE_IT(__HANDLE__, __INTERRUPT__) ((__HANDLE__)->Instance->DIER &= ~(__INTERRUPT__))
+#define __HAL_TIM_ENABLE_DMA(__HANDLE__, __DMA__) ((__HANDLE__)->Instance->DIER |= (__DMA__))
+#define __HAL_TIM_GET_FLAG(__HANDLE__, __FLAG__) (((__HANDLE__)->Instance->SR & (__FLAG__)) == (__FLAG__))
+// The status registers are rc_w0 (writing 1 has no effect), so a plain
+// assignment of ~FLAG would set all other flags in the simulated register.
+#define __HAL_TIM_CLEAR_FLAG(__HANDLE__, __FLAG__) ((__HANDLE__)->Instance->SR &= ~(__FLAG__))
+
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef* htim, uint32_t Channel);
+HAL_StatusTypeDef HAL_TIM_PWM_Start_IT(TIM_HandleTypeDef* htim, uint32_t Channel);
+HAL_StatusTypeDef HAL_TIMEx_PWMN_Start(TIM_HandleTypeDef* htim, uint32_t Channel);
+HAL_StatusTypeDef HAL_TIM_Encoder_Start(TIM_HandleTypeDef* htim, uint32_t Channel);
+HAL_StatusTypeDef HAL_TIM_IC_ConfigChannel(TIM_HandleTypeDef* htim, TIM_IC_InitTypeDef* sConfig, uint32_t Channel);
+HAL_StatusTypeDef HAL_TIM_IC_Start_IT(TIM_HandleTypeDef* htim, uint32_t Channel);
+
+/* ADC -----------------------------------------------------------------------*/
+
+typedef struct {
+    uint32_t ClockPrescaler;
+    uint32_t Resolution;
+    uint32_t DataAlign;
+    uint32_t ScanConvMode;
+    uint32_t EOCSelection;
+    uint32_t ContinuousConvMode;
+    uint32_t NbrOfConversion;
+    uint32_t DiscontinuousConvMode;
+    uint32_t NbrOfDiscConversion;
+    uint32_t ExternalTrigConv;
+    uint32_t ExternalTrigConvEdge;
+    uint32_t DMAContinuousRequests;
+} ADC_InitTypeDef;
+
+typedef struct {
+    uint32_t Channel;
+    uint32_t Rank;
+    uint32_t SamplingTime;
+    uint32_t Offset;
+} ADC_ChannelConfTypeDef;
+
+typedef struct {
+    ADC_TypeDef* Instance;
+    ADC_InitTypeDef Init;
+    DMA_HandleTypeDef* DMA_Handle;
+} ADC_HandleTypeDef;
+
+#define ADC_CLOCK_SYNC_PCLK_DIV4            0x00010000U
+#define ADC_RESOLUTION_12B                  0x00000000U
+#define ADC_DATAALIGN_RIGHT                 0x00000000U
+#define ADC_EOC_SINGLE_CONV                 0x00000001U
+#define ADC_EXTERNALTRIGCONVEDGE_NONE       0x00000000U
+#define ADC_SOFTWARE_START                  0x0F000001U
+#define ADC_SAMPLETIME_15CYCLES             0x00000001U
+#define ADC_INJECTED_RANK_1                 0x00000001U
+#define ADC_IT_EOC                          ADC_CR1_EOCIE
+#define ADC_IT_JEOC                         ADC_CR1_JEOCIE
+#define ADC_FLAG_EOC                        ADC_SR_EOC
+#define ADC_FLAG_JEOC                       ADC_SR_JEOC
+#define ADC_FLAG_JSTRT                      ADC_SR_JSTRT
+#define ADC_FLAG_STRT                       ADC_SR_STRT
+
+#define __HAL_ADC_ENABLE(__HANDLE__) ((__HANDLE__)->Instance->CR2 |= ADC_CR2_ADON)
+#define __HAL_ADC_ENABLE_IT(__HANDLE__, __INTERRUPT__) ((__HANDLE__)->Instance->CR1 |= (__INTERRUPT__))
+#define __HAL_ADC_DISABLE_IT(__HANDLE__, __INTERRUPT__) ((__HANDLE__)->Instance->CR1 &= ~(__INTERRUPT__))
+#define __HAL_ADC_GET_IT_SOURCE(__HANDLE__, __INTERRUPT__) (((__HANDLE__)->Instance->CR1 & (__INTERRUPT__)) == (__INTERRUPT__))
+#define __HAL_ADC_GET_FLAG(__HANDLE__, __FLAG__) ((((__HANDLE__)->Instance->SR) & (__FLAG__)) == (__FLAG__))
+#define __HAL_ADC_CLEAR_FLAG(__HANDLE__, __FLAG__) (((__HANDLE__)->Instance->SR) &= ~(__FLAG__))
+
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef* hadc);
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef* hadc, ADC_ChannelConfTypeDef* sConfig);
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef* hadc, uint32_t* pData, uint32_t Length);
+uint32_t HAL_ADC_GetValue(ADC_HandleTypeDef* hadc);
+uint32_t HAL_ADCEx_InjectedGetValue(ADC_HandleTypeDef* hadc, uint32_t InjectedRank);
+
+/* SPI, CAN, I2C -------------------------------------------------------------*/
+
+typedef struct {
+    void* Instance;
+} SPI_HandleTypeDef;
+
+typedef struct {
+    void* Instance;
+} CAN_HandleTypeDef;
+
+typedef struct {
+    void* Instance;
+} I2C_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef* hspi, uint8_t* pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef* hspi, uint8_t* pTxData, uint8_t* pRxData, uint16_t Size, uint32_t Timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+// The CubeMX generated stm32f4xx_hal_conf.h pulls in the board definitions
+#include "main.h"
+
+#endif /* __SIM_STM32F4XX_HAL_H */
@@ -0,0 +1,72 @@
+tup.include('../build.lua')
+
+-- Host build of the motor control code against a simulated board.
+-- Enable with CONFIG_BUILD_SIMULATOR=true in tup.config.
+
+FLAGS += '-DHW_VERSION_MAJOR=3 -DHW_VERSION_MINOR=6'
+FLAGS += '-DHW_VERSION_VOLTAGE=24'
+FLAGS += '-DSTM32F405xx'
+FLAGS += { '-O2', '-g', '-Wall' }
+
+LDFLAGS += '-lm -lpthread'
+
+toolchain = GCCToolchain('', 'build', FLAGS, LDFLAGS)
+
+if tup.getconfig("BUILD_SIMULATOR") == "true" then
+    build{
+        name='odrive_sim',
+        toolchains={toolchain},
+        packages={},
+        sources={
+            '../Drivers/DRV8301/drv8301.c',
+            '../MotorControl/utils.c',
+            '../MotorControl/arm_sin_f32.c',
+            '../MotorControl/arm_cos_f32.c',
+            '../MotorControl/arm_sincos_f32.c',
+            '../MotorControl/low_level.cpp',
+            '../MotorControl/axis.cpp',
+            '../MotorControl/motor.cpp',
+            '../MotorControl/encoder.cpp',
+            '../MotorControl/controller.cpp',
+            '../MotorControl/sensorless_estimator.cpp',
+            '../MotorControl/trapTraj.cpp',
+            '../fibre/cpp/protocol.cpp',
+            'sim_hal.cpp',
+            'sim_rtos.cpp',
+            'motor_model.cpp',
+            'simulator.cpp',
+            'sim_main.cpp'
+        },
+        includes={
+            'Inc',
+            '../Board/v3/Inc',
+            '../Drivers/DRV8301',
+            '../MotorControl',
+            '../fibre/cpp/include',
+            '..'
+        }
+    }
+
+    -- Equivalence checks and micro benchmarks of the math kernels
+    build{
+        name='odrive_kernel_bench',
+        toolchains={toolchain},
+        packages={},
+        sources={
+            '../MotorControl/utils.c',
+            '../MotorControl/arm_sin_f32.c',
+            '../MotorControl/arm_cos_f32.c',
+            '../MotorControl/arm_sincos_f32.c',
+            'sim_hal.cpp',
+            'sim_rtos.cpp',
+            'kernel_bench.cpp'
+        },
+        includes={
+            'Inc',
+            '../Board/v3/Inc',
+            '../MotorControl',
+            '../fibre/cpp/include',
+            '..'
+        }
+    }
+end
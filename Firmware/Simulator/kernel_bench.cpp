@@ -0,0 +1,568 @@
+/*
+* @brief Host-side equivalence checks and micro benchmarks of the motor
+* control math kernels.
+*
+* Each kernel is compared against a reference (the previous implementation
+* or libm) and timed on the host. Usage:
+*
+*   odrive_kernel_bench [--iterations <n>] [--count-stream <file>]
+*
+* --count-stream replays a recorded encoder count stream (one count per
+* line, one line per control loop iteration) through the encoder PLL.
+*
+* Exits with a non-zero status if any check fails.
+*/
+
+#include <utils.h>
+#include <math_kernels.hpp>
+#include <encoder_pll.hpp>
+#include "sim_hal.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+static size_t iterations = 1 << 22;
+static int failures = 0;
+static volatile float sink;
+
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+// @brief Returns the average time per call of fn(i) for i in [0, iterations) [ns]
+template<typename T>
+static double time_per_op(const T& fn) {
+    // Warm up the caches and the branch predictor
+    for (size_t i = 0; i < iterations / 16; ++i)
+        sink = fn(i);
+    auto start = std::chrono::steady_clock::now();
+    float acc = 0.0f;
+    for (size_t i = 0; i < iterations; ++i)
+        acc += fn(i);
+    auto end = std::chrono::steady_clock::now();
+    sink = acc;
+    return std::chrono::duration<double, std::nano>(end - start).count() / (double)iterations;
+}
+
+static void report(const char* kernel, double ns, double reference_ns, double max_error) {
+    printf("%-28s %7.2f ns/op   reference %7.2f ns/op   max error %.2e\n",
+           kernel, ns, reference_ns, max_error);
+}
+
+// @brief Uniformly distributed test inputs, the same ones on every run
+static std::vector<float> random_floats(size_t n, float min, float max) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> dist(min, max);
+    std::vector<float> values(n);
+    for (float& value : values)
+        value = dist(rng);
+    return values;
+}
+
+/* SVM -----------------------------------------------------------------------*/
+
+// The sextant based SVM() from before the min/max formulation
+static int svm_reference(float alpha, float beta, float* tA, float* tB, float* tC) {
+    int Sextant;
+
+    if (beta >= 0.0f) {
+        if (alpha >= 0.0f) {
+            Sextant = (one_by_sqrt3 * beta > alpha) ? 2 : 1;
+        } else {
+            Sextant = (-one_by_sqrt3 * beta > alpha) ? 3 : 2;
+        }
+    } else {
+        if (alpha >= 0.0f) {
+            Sextant = (-one_by_sqrt3 * beta > alpha) ? 5 : 6;
+        } else {
+            Sextant = (one_by_sqrt3 * beta > alpha) ? 4 : 5;
+        }
+    }
+
+    switch (Sextant) {
+        case 1: {
+            float t1 = alpha - one_by_sqrt3 * beta;
+            float t2 = two_by_sqrt3 * beta;
+            *tA = (1.0f - t1 - t2) * 0.5f;
+            *tB = *tA + t1;
+            *tC = *tB + t2;
+        } break;
+        case 2: {
+            float t2 = alpha + one_by_sqrt3 * beta;
+            float t3 = -alpha + one_by_sqrt3 * beta;
+            *tB = (1.0f - t2 - t3) * 0.5f;
+            *tA = *tB + t3;
+            *tC = *tA + t2;
+        } break;
+        case 3: {
+            float t3 = two_by_sqrt3 * beta;
+            float t4 = -alpha - one_by_sqrt3 * beta;
+            *tB = (1.0f - t3 - t4) * 0.5f;
+            *tC = *tB + t3;
+            *tA = *tC + t4;
+        } break;
+        case 4: {
+            float t4 = -alpha + one_by_sqrt3 * beta;
+            float t5 = -two_by_sqrt3 * beta;
+            *tC = (1.0f - t4 - t5) * 0.5f;
+            *tB = *tC + t5;
+            *tA = *tB + t4;
+        } break;
+        case 5: {
+            float t5 = -alpha - one_by_sqrt3 * beta;
+            float t6 = alpha - one_by_sqrt3 * beta;
+            *tC = (1.0f - t5 - t6) * 0.5f;
+            *tA = *tC + t5;
+            *tB = *tA + t6;
+        } break;
+        case 6: {
+            float t6 = -two_by_sqrt3 * beta;
+            float t1 = alpha + one_by_sqrt3 * beta;
+            *tA = (1.0f - t6 - t1) * 0.5f;
+            *tC = *tA + t1;
+            *tB = *tC + t6;
+        } break;
+    }
+
+    int result_valid =
+            *tA >= 0.0f && *tA <= 1.0f
+         && *tB >= 0.0f && *tB <= 1.0f
+         && *tC >= 0.0f && *tC <= 1.0f;
+    return result_valid ? 0 : -1;
+}
+
+static void test_svm() {
+    // Every point of a 2001 x 2001 grid over the square around the disc of
+    // radius 1.2, which contains the SVM hexagon (circumradius 1).
+    const int steps = 1000;
+    const float range = 1.2f;
+    float max_diff = 0.0f;
+    size_t num_valid = 0;
+    size_t num_mismatch = 0;     // validity differs
+    size_t num_near_edge = 0;    // ... but only within rounding of the hexagon edge
+    for (int i = -steps; i <= steps; ++i) {
+        for (int j = -steps; j <= steps; ++j) {
+            float alpha = range * (float)i / (float)steps;
+            float beta = range * (float)j / (float)steps;
+            if (alpha * alpha + beta * beta > range * range)
+                continue;
+            float tA, tB, tC, rA, rB, rC;
+            int result = SVM(alpha, beta, &tA, &tB, &tC);
+            int reference = svm_reference(alpha, beta, &rA, &rB, &rC);
+            if (result != reference) {
+                ++num_mismatch;
+                float spread = std::max(rA, std::max(rB, rC)) - std::min(rA, std::min(rB, rC));
+                if (fabsf(spread - 1.0f) < 1e-6f)
+                    ++num_near_edge;
+            } else if (result == 0) {
+                ++num_valid;
+                max_diff = std::max(max_diff, std::max(fabsf(tA - rA), std::max(fabsf(tB - rB), fabsf(tC - rC))));
+            }
+        }
+    }
+    printf("SVM: %zu valid points, %zu validity mismatches (%zu at the hexagon edge)\n",
+           num_valid, num_mismatch, num_near_edge);
+    check(max_diff < 1e-6f, "SVM timings differ from the reference");
+    check(num_mismatch == num_near_edge, "SVM validity differs from the reference away from the hexagon edge");
+
+    float tA, tB, tC;
+    check(SVM(NAN, 0.0f, &tA, &tB, &tC) != 0, "SVM accepts NaN alpha");
+    check(SVM(0.0f, NAN, &tA, &tB, &tC) != 0, "SVM accepts NaN beta");
+    check(SVM(INFINITY, 0.0f, &tA, &tB, &tC) != 0, "SVM accepts infinite alpha");
+
+    // Vectors on a circle inside the linear range. The rotating vector gives
+    // the branch predictor an easy pattern, the shuffled one does not.
+    const size_t n = 4096;
+    std::vector<float> alphas(n), betas(n);
+    for (size_t i = 0; i < n; ++i) {
+        float phase = 2.0f * M_PI * (float)i / (float)n;
+        alphas[i] = 0.8f * cosf(phase);
+        betas[i] = 0.8f * sinf(phase);
+    }
+    std::vector<size_t> shuffled(n);
+    for (size_t i = 0; i < n; ++i)
+        shuffled[i] = i;
+    std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(1));
+
+    auto svm_sum = [&](decltype(SVM)* fn, size_t k) {
+        float tA, tB, tC;
+        fn(alphas[k], betas[k], &tA, &tB, &tC);
+        return tA + tB + tC;
+    };
+    report("SVM (rotating)",
+           time_per_op([&](size_t i) { return svm_sum(SVM, i % n); }),
+           time_per_op([&](size_t i) { return svm_sum(svm_reference, i % n); }),
+           max_diff);
+    report("SVM (shuffled)",
+           time_per_op([&](size_t i) { return svm_sum(SVM, shuffled[i % n]); }),
+           time_per_op([&](size_t i) { return svm_sum(svm_reference, shuffled[i % n]); }),
+           max_diff);
+}
+
+/* Scalar kernels (math_kernels.hpp) -----------------------------------------*/
+
+// The loop based wrap_pm() from before math_kernels.hpp
+static float wrap_pm_reference(float x, float pm_range) {
+    while (x >= pm_range) x -= (2.0f * pm_range);
+    while (x < -pm_range) x += (2.0f * pm_range);
+    return x;
+}
+
+// The fmodf based fmodf_pos() from before math_kernels.hpp
+static float fmodf_pos_reference(float x, float y) {
+    float out = fmodf(x, y);
+    if (out < 0.0f)
+        out += y;
+    return out;
+}
+
+// The remainder based mod() from before math_kernels.hpp
+static int mod_reference(int dividend, int divisor) {
+    int r = dividend % divisor;
+    return (r < 0) ? (r + divisor) : r;
+}
+
+// @brief Returns the distance between a and b on a circle of the given circumference
+static double circular_error(double a, double b, double circumference) {
+    double d = fmod(fabs(a - b), circumference);
+    return std::min(d, circumference - d);
+}
+
+static void test_scalar_kernels() {
+    const size_t n = 4096;
+
+    // Compile time evaluation
+    static_assert(wrap_pm_pi(4.0f) < 0.0f, "wrap_pm_pi must be constexpr");
+    static_assert(mod(-1, 8192) == 8191 && mod(-1, 6283) == 6282, "mod must be constexpr");
+
+    // wrap_pm_pi: the control loop calls it with angles that are at most a
+    // few radians outside the range, where the reference loops once or twice
+    {
+        std::vector<float> x = random_floats(n, -3.0f * M_PI, 3.0f * M_PI);
+        double max_error = 0.0;
+        for (float v : x) {
+            float result = wrap_pm_pi(v);
+            check(result >= -M_PI && result < M_PI, "wrap_pm_pi out of range");
+            max_error = std::max(max_error, (double)fabsf(result - wrap_pm_reference(v, M_PI)));
+        }
+        report("wrap_pm_pi", time_per_op([&](size_t i) { return wrap_pm_pi(x[i % n]); }),
+               time_per_op([&](size_t i) { return wrap_pm_reference(x[i % n], M_PI); }), max_error);
+    }
+
+    // wrap_pm_pi far outside the range, where the reference loops up to a
+    // thousand times. Compared with the exact result in double precision.
+    {
+        std::vector<float> x = random_floats(n, -1000.0f * 2.0f * M_PI, 1000.0f * 2.0f * M_PI);
+        double max_error = 0.0;
+        for (float v : x) {
+            float result = wrap_pm_pi(v);
+            check(result >= -M_PI && result < M_PI, "wrap_pm_pi out of range");
+            max_error = std::max(max_error, circular_error(result, v, 2.0 * M_PI));
+        }
+        report("wrap_pm_pi (+-1000 turns)", time_per_op([&](size_t i) { return wrap_pm_pi(x[i % n]); }),
+               time_per_op([&](size_t i) { return wrap_pm_reference(x[i % n], M_PI); }), max_error);
+    }
+    check(wrap_pm_pi(INFINITY) == -M_PI, "wrap_pm_pi(inf) must return -pi");
+    check(isnan(wrap_pm_pi(NAN)), "wrap_pm_pi(NaN) must return NaN");
+
+    // wrap_pm and fmodf_pos on encoder counts, as in Encoder::update and
+    // Controller::update
+    {
+        const float cpr = 8192.0f;
+        std::vector<float> x = random_floats(n, -cpr, cpr);
+        double max_error = 0.0;
+        for (float v : x)
+            max_error = std::max(max_error, (double)fabsf(wrap_pm(v, 0.5f * cpr) - wrap_pm_reference(v, 0.5f * cpr)));
+        report("wrap_pm (counts)", time_per_op([&](size_t i) { return wrap_pm(x[i % n], 0.5f * cpr); }),
+               time_per_op([&](size_t i) { return wrap_pm_reference(x[i % n], 0.5f * cpr); }), max_error);
+    }
+    {
+        const float cpr = 8192.0f;
+        std::vector<float> x = random_floats(n, -0.5f * cpr, 1.5f * cpr);
+        double max_error = 0.0;
+        for (float v : x) {
+            float result = fmodf_pos(v, cpr);
+            check(result >= 0.0f && result < cpr, "fmodf_pos out of range");
+            max_error = std::max(max_error, circular_error(result, fmodf_pos_reference(v, cpr), cpr));
+        }
+        report("fmodf_pos (counts)", time_per_op([&](size_t i) { return fmodf_pos(x[i % n], cpr); }),
+               time_per_op([&](size_t i) { return fmodf_pos_reference(x[i % n], cpr); }), max_error);
+    }
+
+    // mod with a power of two CPR and with the divisors used by the hall and
+    // sin/cos encoder modes
+    for (int divisor : {8192, 6283, 6}) {
+        std::mt19937 rng(1);
+        std::uniform_int_distribution<int> dist(-1000000, 1000000);
+        std::vector<int> x(n);
+        for (int& v : x)
+            v = dist(rng);
+        size_t mismatches = 0;
+        for (int v : x)
+            mismatches += mod(v, divisor) != mod_reference(v, divisor);
+        check(mismatches == 0, "mod differs from the reference");
+        char name[32];
+        snprintf(name, sizeof(name), "mod (divisor %d)", divisor);
+        // volatile divisor: the control loop takes it from the config
+        volatile int d = divisor;
+        report(name, time_per_op([&](size_t i) { return (float)mod(x[i % n], d); }),
+               time_per_op([&](size_t i) { return (float)mod_reference(x[i % n], d); }), (double)mismatches);
+    }
+
+    // fast_atan2 against libm
+    {
+        std::vector<float> angles = random_floats(n, -M_PI, M_PI);
+        std::vector<float> magnitudes = random_floats(n, 0.01f, 100.0f);
+        std::vector<float> y(n), x(n);
+        double max_error = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            y[i] = magnitudes[i] * sinf(angles[i]);
+            x[i] = magnitudes[i] * cosf(angles[i]);
+            max_error = std::max(max_error, circular_error(fast_atan2(y[i], x[i]), atan2((double)y[i], (double)x[i]), 2.0 * M_PI));
+        }
+        report("fast_atan2", time_per_op([&](size_t i) { return fast_atan2(y[i % n], x[i % n]); }),
+               time_per_op([&](size_t i) { return atan2f(y[i % n], x[i % n]); }), max_error);
+    }
+
+    // horner_fma against the same polynomial evaluated in double precision.
+    // Without -mfma, fmaf is a library call on x86. On the STM32 it is a
+    // single instruction, so the host timing is pessimistic.
+    {
+        const float coeffs[] = { 0.0237f, -0.312f, 1.5f, -4.2f, 7.0f, 20.0f };
+        const size_t count = sizeof(coeffs) / sizeof(coeffs[0]);
+        std::vector<float> x = random_floats(n, 0.0f, 1.0f);
+        double max_error = 0.0;
+        for (float v : x) {
+            double exact = 0.0;
+            for (float c : coeffs)
+                exact = exact * v + c;
+            max_error = std::max(max_error, fabs(horner_fma(v, coeffs, count) - exact));
+        }
+        report("horner_fma (degree 5)", time_per_op([&](size_t i) { return horner_fma(x[i % n], coeffs, count); }),
+               time_per_op([&](size_t i) { double r = 0.0; for (float c : coeffs) r = r * x[i % n] + c; return (float)r; }),
+               max_error);
+    }
+
+    // Fused sine and cosine against two table lookups each
+    {
+        std::vector<float> x = random_floats(n, -M_PI, M_PI);
+        std::vector<float> delta = random_floats(n, -0.1f, 0.1f);
+        double max_error = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            float s, c, s_adv, c_adv;
+            our_arm_sincos_advance_f32(x[i], delta[i], &s, &c, &s_adv, &c_adv);
+            max_error = std::max(max_error, std::max(fabs(s - sin((double)x[i])), fabs(c - cos((double)x[i]))));
+            max_error = std::max(max_error, std::max(fabs(s_adv - sin((double)x[i] + delta[i])),
+                                                     fabs(c_adv - cos((double)x[i] + delta[i]))));
+        }
+        report("sincos_advance (vs 4 lookups)",
+               time_per_op([&](size_t i) {
+                   float s, c, s_adv, c_adv;
+                   our_arm_sincos_advance_f32(x[i % n], delta[i % n], &s, &c, &s_adv, &c_adv);
+                   return s + c + s_adv + c_adv;
+               }),
+               time_per_op([&](size_t i) {
+                   float v = x[i % n], v_adv = x[i % n] + delta[i % n];
+                   return our_arm_sin_f32(v) + our_arm_cos_f32(v) + our_arm_sin_f32(v_adv) + our_arm_cos_f32(v_adv);
+               }),
+               max_error);
+    }
+}
+
+/* Encoder PLL (encoder_pll.hpp) ---------------------------------------------*/
+
+static const char* count_stream_file = nullptr;
+
+// The float PLL of Encoder::update from before encoder_pll.hpp
+struct FloatPllReference {
+    float pos_estimate = 0.0f;  // [count]
+    float pos_cpr = 0.0f;       // [count]
+    float vel_estimate = 0.0f;  // [count/s]
+
+    bool update(int32_t count, int32_t count_in_cpr, int32_t cpr, float dt, float kp, float ki) {
+        pos_estimate += dt * vel_estimate;
+        pos_cpr      += dt * vel_estimate;
+        float delta_pos     = (float)(count - (int32_t)floorf(pos_estimate));
+        float delta_pos_cpr = (float)(count_in_cpr - (int32_t)floorf(pos_cpr));
+        delta_pos_cpr = wrap_pm_reference(delta_pos_cpr, 0.5f * (float)cpr);
+        pos_estimate += dt * kp * delta_pos;
+        pos_cpr      += dt * kp * delta_pos_cpr;
+        pos_cpr = fmodf_pos_reference(pos_cpr, (float)cpr);
+        vel_estimate += dt * ki * delta_pos_cpr;
+        if (fabsf(vel_estimate) < 0.5f * dt * ki) {
+            vel_estimate = 0.0f;
+            return true;
+        }
+        return false;
+    }
+};
+
+struct CountStream_t {
+    const char* name;
+    std::vector<int32_t> counts;  // encoder count per update, wraps like the hardware count
+    std::vector<double> truth;    // exact position, if known [count]
+};
+
+static const int32_t pll_cpr = 8192;
+static const float pll_dt = 1.0f / 8000.0f;
+static const float pll_kp = 2.0f * 1000.0f;  // see Encoder::update_pll_gains()
+static const float pll_ki = 0.25f * pll_kp * pll_kp;
+
+// @brief Samples a motion profile pos(t) [count] at the PLL rate
+template<typename T>
+static CountStream_t make_count_stream(const char* name, double duration, const T& pos) {
+    CountStream_t stream = { name, {}, {} };
+    for (size_t i = 0; i < (size_t)(duration / pll_dt); ++i) {
+        double p = pos(i * (double)pll_dt);
+        stream.counts.push_back((int32_t)(uint32_t)(int64_t)floor(p));
+        stream.truth.push_back(p);
+    }
+    return stream;
+}
+
+// @brief Loads a recorded stream: one encoder count per line, one line per
+// update at the default control loop rate (8 kHz)
+static bool load_count_stream(const char* file, CountStream_t* stream) {
+    FILE* fp = fopen(file, "r");
+    if (!fp)
+        return false;
+    long count;
+    while (fscanf(fp, "%ld", &count) == 1)
+        stream->counts.push_back((int32_t)count);
+    fclose(fp);
+    return !stream->counts.empty();
+}
+
+// @brief Distance between a wrapping count position and an exact position
+static double count_error(CountPos_t pos, double exact) {
+    int64_t n = (int64_t)floor(exact);
+    return (double)(int32_t)((uint32_t)pos.counts - (uint32_t)n) + pos.frac - (exact - (double)n);
+}
+
+static void test_encoder_pll() {
+    std::vector<CountStream_t> streams;
+    // Streams starting at zero, where the float reference has sub-count resolution
+    streams.push_back(make_count_stream("slow (20 counts/s)", 2.0, [](double t) { return 20.0 * t; }));
+    streams.push_back(make_count_stream("fast (50 rev/s)", 2.0, [](double t) { return 50.0 * pll_cpr * t; }));
+    streams.push_back(make_count_stream("reversing", 2.0, [](double t) { return 20000.0 * sin(2.0 * M_PI * 2.0 * t); }));
+    streams.push_back(make_count_stream("ramp", 1.0, [](double t) { return 0.5 * 1e6 * t * t; }));
+    if (count_stream_file) {
+        CountStream_t recorded = { count_stream_file, {}, {} };
+        check(load_count_stream(count_stream_file, &recorded), "count stream file could not be read");
+        streams.push_back(recorded);
+    }
+
+    printf("encoder PLL vs float reference:\n");
+    for (const CountStream_t& stream : streams) {
+        FloatPllReference reference;
+        CountPos_t pos = { stream.counts[0], 0.0f };
+        CountPos_t pos_cpr = { mod(stream.counts[0], pll_cpr), 0.0f };
+        float vel = 0.0f;
+        reference.pos_estimate = (float)stream.counts[0];
+        reference.pos_cpr = (float)mod(stream.counts[0], pll_cpr);
+        double max_pos_diff = 0.0, max_pos_cpr_diff = 0.0, max_vel_diff = 0.0, max_vel = 0.0;
+        for (int32_t count : stream.counts) {
+            int32_t count_in_cpr = mod(count, pll_cpr);
+            encoder_pll_update(pos, pos_cpr, vel, count, count_in_cpr, pll_cpr, pll_dt, pll_kp, pll_ki);
+            reference.update(count, count_in_cpr, pll_cpr, pll_dt, pll_kp, pll_ki);
+            max_pos_diff = std::max(max_pos_diff, fabs(count_error(pos, reference.pos_estimate)));
+            max_pos_cpr_diff = std::max(max_pos_cpr_diff,
+                    circular_error(count_pos_to_float(pos_cpr), reference.pos_cpr, pll_cpr));
+            max_vel_diff = std::max(max_vel_diff, (double)fabsf(vel - reference.vel_estimate));
+            max_vel = std::max(max_vel, (double)fabsf(reference.vel_estimate));
+            check(pos_cpr.counts >= 0 && pos_cpr.counts < pll_cpr && pos_cpr.frac >= 0.0f && pos_cpr.frac < 1.0f,
+                  "encoder PLL: pos_cpr out of range");
+        }
+        printf("  %-24s max diff: pos %.2e, pos_cpr %.2e, vel %.2e counts(/s)\n",
+               stream.name, max_pos_diff, max_pos_cpr_diff, max_vel_diff);
+        // A rounding difference can flip a floor in the phase detector. That
+        // kicks both estimates by at most dt * kp (pos) and dt * ki (vel)
+        // apart, after which they converge again.
+        check(max_pos_diff <= 2.0 * pll_dt * pll_kp && max_pos_cpr_diff <= 2.0 * pll_dt * pll_kp,
+              "encoder PLL: position differs from the float reference");
+        check(max_vel_diff <= 2.0 * pll_dt * pll_ki + 1e-3 * max_vel,
+              "encoder PLL: velocity differs from the float reference");
+    }
+
+    // Far from zero the float reference has lost its resolution, compare
+    // both against the exact position instead. The last stream crosses the
+    // int32 wrap around of the count.
+    printf("encoder PLL vs exact position (after 0.1 s settling):\n");
+    const double far_starts[] = { 16777216.0 /* 2^24 */, 1073741824.0 /* 2^30 */, 2147483647.0 - 400000.0 };
+    for (double start : far_starts) {
+        CountStream_t stream = make_count_stream("", 2.0, [&](double t) { return start + 400000.0 * t; });
+        FloatPllReference reference;
+        CountPos_t pos = { stream.counts[0], 0.0f };
+        CountPos_t pos_cpr = { mod(stream.counts[0], pll_cpr), 0.0f };
+        float vel = 400000.0f;
+        reference.pos_estimate = (float)stream.counts[0];
+        reference.pos_cpr = (float)mod(stream.counts[0], pll_cpr);
+        reference.vel_estimate = vel;
+        double max_error = 0.0, max_reference_error = 0.0;
+        for (size_t i = 0; i < stream.counts.size(); ++i) {
+            int32_t count = stream.counts[i];
+            int32_t count_in_cpr = mod(count, pll_cpr);
+            encoder_pll_update(pos, pos_cpr, vel, count, count_in_cpr, pll_cpr, pll_dt, pll_kp, pll_ki);
+            reference.update(count, count_in_cpr, pll_cpr, pll_dt, pll_kp, pll_ki);
+            if (i * pll_dt < 0.1f)
+                continue;
+            double exact = stream.truth[i];
+            max_error = std::max(max_error, fabs(count_error(pos, exact)));
+            max_reference_error = std::max(max_reference_error, fabs((double)reference.pos_estimate - exact));
+        }
+        printf("  start %-16.0f max error %.2e counts, float reference %.2e counts\n",
+               start, max_error, max_reference_error);
+        check(max_error < 1.0, "encoder PLL: lost track far from zero");
+    }
+
+    const CountStream_t& stream = streams[2];
+    size_t n = stream.counts.size();
+    CountPos_t pos = { 0, 0.0f }, pos_cpr = { 0, 0.0f };
+    float vel = 0.0f;
+    FloatPllReference reference;
+    report("encoder_pll_update",
+           time_per_op([&](size_t i) {
+               int32_t count = stream.counts[i % n];
+               encoder_pll_update(pos, pos_cpr, vel, count, mod(count, pll_cpr), pll_cpr, pll_dt, pll_kp, pll_ki);
+               return vel;
+           }),
+           time_per_op([&](size_t i) {
+               int32_t count = stream.counts[i % n];
+               reference.update(count, mod(count, pll_cpr), pll_cpr, pll_dt, pll_kp, pll_ki);
+               return reference.vel_estimate;
+           }),
+           0.0);
+}
+
+/* Main ----------------------------------------------------------------------*/
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+            iterations = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--count-stream") && i + 1 < argc) {
+            count_stream_file = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--iterations <n>] [--count-stream <file>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    sim_init_tables();
+    test_svm();
+    test_scalar_kernels();
+    test_encoder_pll();
+
+    if (failures)
+        printf("%d check(s) failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+#include "motor_model.hpp"
+
+#include <math.h>
+
+struct State_t {
+    double id, iq, pos, vel;
+};
+
+MotorModel::MotorModel(const Config_t& config) :
+        config_(config),
+        pole_pairs_((double)config.pole_pairs),
+        pos_(config.initial_position)
+{
+}
+
+// @brief Computes the state derivative for the given stationary frame voltages
+static State_t derivative(const MotorModel& m, const State_t& s, double v_alpha, double v_beta, bool enabled) {
+    const MotorModel::Config_t& c = m.config_;
+    double theta_e = m.pole_pairs_ * s.pos;
+    double omega_e = m.pole_pairs_ * s.vel;
+    double cos_e = cos(theta_e);
+    double sin_e = sin(theta_e);
+
+    double sat = m.saturation_factor(s.id, s.iq);
+    double Ld = sat * c.phase_inductance_d;
+    double Lq = sat * c.phase_inductance_q;
+
+    State_t ds = {};
+    if (enabled) {
+        double vd = cos_e * v_alpha + sin_e * v_beta;
+        double vq = -sin_e * v_alpha + cos_e * v_beta;
+        ds.id = (vd - c.phase_resistance * s.id + omega_e * Lq * s.iq) / Ld;
+        ds.iq = (vq - c.phase_resistance * s.iq - omega_e * (Ld * s.id + c.flux_linkage)) / Lq;
+    }
+
+    double torque = 1.5 * m.pole_pairs_ * (c.flux_linkage * s.iq + (Ld - Lq) * s.id * s.iq);
+    double friction = c.viscous_friction * s.vel + c.coulomb_friction * tanh(s.vel / 0.01);
+    ds.pos = s.vel;
+    ds.vel = (torque - friction - m.load_torque_) / c.inertia;
+    return ds;
+}
+
+static State_t add(const State_t& s, const State_t& ds, double h) {
+    return { s.id + h * ds.id, s.iq + h * ds.iq, s.pos + h * ds.pos, s.vel + h * ds.vel };
+}
+
+void MotorModel::step(double dt, const double v_abc[3], bool enabled) {
+    // Line-to-neutral voltages of a star connected motor (Clarke transform)
+    double v_alpha = (2.0 * v_abc[0] - v_abc[1] - v_abc[2]) / 3.0;
+    double v_beta = (v_abc[1] - v_abc[2]) / sqrt(3.0);
+
+    if (!enabled) {
+        id_ = 0.0;
+        iq_ = 0.0;
+    }
+
+    // Classic 4th order Runge-Kutta
+    State_t s = { id_, iq_, pos_, vel_ };
+    State_t k1 = derivative(*this, s, v_alpha, v_beta, enabled);
+    State_t k2 = derivative(*this, add(s, k1, dt / 2), v_alpha, v_beta, enabled);
+    State_t k3 = derivative(*this, add(s, k2, dt / 2), v_alpha, v_beta, enabled);
+    State_t k4 = derivative(*this, add(s, k3, dt), v_alpha, v_beta, enabled);
+    id_ += dt / 6 * (k1.id + 2 * k2.id + 2 * k3.id + k4.id);
+    iq_ += dt / 6 * (k1.iq + 2 * k2.iq + 2 * k3.iq + k4.iq);
+    pos_ += dt / 6 * (k1.pos + 2 * k2.pos + 2 * k3.pos + k4.pos);
+    vel_ += dt / 6 * (k1.vel + 2 * k2.vel + 2 * k3.vel + k4.vel);
+}
+
+void MotorModel::get_phase_currents(double i_abc[3]) const {
+    double theta_e = electrical_angle();
+    double cos_e = cos(theta_e);
+    double sin_e = sin(theta_e);
+    double i_alpha = cos_e * id_ - sin_e * iq_;
+    double i_beta = sin_e * id_ + cos_e * iq_;
+    i_abc[0] = i_alpha;
+    i_abc[1] = -0.5 * i_alpha + (sqrt(3.0) / 2.0) * i_beta;
+    i_abc[2] = -0.5 * i_alpha - (sqrt(3.0) / 2.0) * i_beta;
+}
+
+double MotorModel::saturation_factor(double id, double iq) const {
+    if (config_.saturation_current <= 0.0f)
+        return 1.0;
+    double i_sqr = id * id + iq * iq;
+    return 1.0 / (1.0 + i_sqr / ((double)config_.saturation_current * config_.saturation_current));
+}
+
+double MotorModel::torque() const {
+    double sat = saturation_factor(id_, iq_);
+    return 1.5 * pole_pairs_ * (config_.flux_linkage * iq_
+            + sat * (config_.phase_inductance_d - config_.phase_inductance_q) * id_ * iq_);
+}
@@ -0,0 +1,59 @@
+#ifndef __MOTOR_MODEL_HPP
+#define __MOTOR_MODEL_HPP
+
+// @brief Average-value model of a surface or interior permanent magnet
+// synchronous motor with a rigidly coupled load.
+//
+// The electrical model is formulated in the rotor (dq) frame:
+//   Ld * did/dt = vd - R * id + omega_e * Lq * iq
+//   Lq * diq/dt = vq - R * iq - omega_e * (Ld * id + flux_linkage)
+// and the torque is
+//   T = 3/2 * pole_pairs * (flux_linkage * iq + (Ld - Lq) * id * iq)
+//
+// Magnetic saturation is approximated by scaling both inductances by
+// 1 / (1 + (|i| / saturation_current)^2), where |i| is the magnitude of the
+// current vector.
+//
+// The inverter is modelled by its average leg voltages over a PWM period,
+// i.e. switching ripple and dead-time are not simulated. When the inverter
+// is disabled the phases float and the phase currents are forced to zero
+// (freewheeling through the body diodes is not modelled).
+class MotorModel {
+public:
+    struct Config_t {
+        // Defaults roughly correspond to the ODrive D5065 motor
+        float phase_resistance = 0.039f;     // [Ohm]
+        float phase_inductance_d = 15.7e-6f; // [H]
+        float phase_inductance_q = 15.7e-6f; // [H]
+        float saturation_current = 0.0f;     // [A] current at which the inductances are halved (0 = no saturation)
+        int pole_pairs = 7;
+        float flux_linkage = 2.92e-3f;       // [Wb] (permanent magnet flux linkage)
+        float inertia = 1.1e-4f;             // [kg m^2] rotor + load
+        float viscous_friction = 2e-5f;      // [Nm/(rad/s)]
+        float coulomb_friction = 0.0f;       // [Nm]
+        float initial_position = 0.3f;       // [rad] mechanical
+    };
+
+    explicit MotorModel(const Config_t& config);
+
+    // @brief Integrates the model over dt with constant inverter leg voltages.
+    // @param v_abc: average voltage of each inverter leg relative to DC- [V]
+    // @param enabled: false if the inverter outputs are floating
+    void step(double dt, const double v_abc[3], bool enabled);
+
+    void get_phase_currents(double i_abc[3]) const;
+    double torque() const;
+    double saturation_factor(double id, double iq) const;
+    double electrical_angle() const { return pole_pairs_ * pos_; }
+
+    Config_t config_;
+    double pole_pairs_;
+
+    double id_ = 0.0;    // [A]
+    double iq_ = 0.0;    // [A]
+    double pos_ = 0.0;   // [rad] mechanical, not wrapped
+    double vel_ = 0.0;   // [rad/s] mechanical
+    double load_torque_ = 0.0; // [Nm] external torque acting against the rotor
+};
+
+#endif // __MOTOR_MODEL_HPP
@@ -0,0 +1,407 @@
+/*
+* Simulated peripheral register files and the HAL functions that operate on
+* them. This replaces the STM32 HAL and the CubeMX generated platform code
+* (Board/v3/Src) for the host build.
+*/
+
+#include "sim_hal.hpp"
+#include "sim_rtos.hpp"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <arm_common_tables.h>
+#include <adc.h>
+#include <can.h>
+#include <gpio.h>
+#include <i2c.h>
+#include <main.h>
+#include <spi.h>
+#include <tim.h>
+
+/* Register files ------------------------------------------------------------*/
+
+GPIO_TypeDef sim_GPIOA, sim_GPIOB, sim_GPIOC, sim_GPIOD;
+TIM_TypeDef sim_TIM1, sim_TIM2, sim_TIM3, sim_TIM4, sim_TIM5, sim_TIM8, sim_TIM13;
+static TIM_TypeDef sim_TIM14;
+ADC_TypeDef sim_ADC1, sim_ADC2, sim_ADC3;
+ADC_Common_TypeDef sim_ADC123_COMMON;
+DMA_Stream_TypeDef sim_DMA2_Stream[8];
+CoreDebug_Type sim_CoreDebug;
+DWT_Type sim_DWT;
+
+TIM_HandleTypeDef htim1, htim2, htim3, htim4, htim5, htim8, htim13;
+ADC_HandleTypeDef hadc1, hadc2, hadc3;
+SPI_HandleTypeDef hspi3;
+CAN_HandleTypeDef hcan1;
+I2C_HandleTypeDef hi2c1;
+
+float32_t sinTable_f32[FAST_MATH_TABLE_SIZE + 1];
+
+void sim_init_tables() {
+    for (int i = 0; i <= FAST_MATH_TABLE_SIZE; ++i)
+        sinTable_f32[i] = (float)sin(2.0 * M_PI * i / FAST_MATH_TABLE_SIZE);
+}
+
+static void init_pwm_timer(TIM_HandleTypeDef* htim, TIM_TypeDef* instance) {
+    htim->Instance = instance;
+    htim->Init.Prescaler = 0;
+    htim->Init.CounterMode = TIM_COUNTERMODE_CENTERALIGNED3;
+    htim->Init.Period = TIM_1_8_PERIOD_CLOCKS;
+    htim->Init.RepetitionCounter = TIM_1_8_RCR;
+    instance->CR1 = TIM_COUNTERMODE_CENTERALIGNED3;
+    instance->ARR = TIM_1_8_PERIOD_CLOCKS;
+    instance->RCR = TIM_1_8_RCR;
+    instance->CR2 = TIM_TRGO_UPDATE;
+}
+
+void sim_init_peripherals() {
+    init_pwm_timer(&htim1, TIM1);
+    init_pwm_timer(&htim8, TIM8);
+    htim2.Instance = TIM2;
+    htim2.Init.Period = TIM_APB1_PERIOD_CLOCKS;
+    TIM2->ARR = TIM_APB1_PERIOD_CLOCKS;
+    htim3.Instance = TIM3;
+    htim3.Init.Period = 0xFFFF;
+    TIM3->ARR = 0xFFFF;
+    htim4.Instance = TIM4;
+    htim4.Init.Period = 0xFFFF;
+    TIM4->ARR = 0xFFFF;
+    htim5.Instance = TIM5;
+    htim5.Init.Period = 0xFFFFFFFF;
+    TIM5->ARR = 0xFFFFFFFF;
+    htim13.Instance = TIM13;
+    htim13.Init.Period = (2 * TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR+1)) * ((float)TIM_APB1_CLOCK_HZ / (float)TIM_1_8_CLOCK_HZ) - 1;
+    TIM13->ARR = htim13.Init.Period;
+    hadc1.Instance = ADC1;
+    hadc2.Instance = ADC2;
+    hadc3.Instance = ADC3;
+
+    // nFAULT is active low
+    sim_gpio_set_input(nFAULT_GPIO_Port, nFAULT_Pin, true);
+}
+
+extern "C" void _Error_Handler(char* file, int line) {
+    fprintf(stderr, "simulator: _Error_Handler called from %s:%d\n", file, line);
+    abort();
+}
+
+/* Core ----------------------------------------------------------------------*/
+
+void NVIC_SystemReset(void) {
+    fprintf(stderr, "simulator: the firmware requested a system reset\n");
+    exit(1);
+}
+
+uint32_t HAL_GetTick(void) {
+    return (uint32_t)((sim_time_ns() + sim_rtos_busy_time_ns()) / 1000000ull);
+}
+
+// @brief Returns the microsecond time base timer (TIM14).
+// Every read is accounted as 100ns of busy time of the calling thread so
+// that busy-wait loops such as delay_us() terminate.
+TIM_TypeDef* sim_time_base_timer(void) {
+    if (osThreadGetId())
+        sim_rtos_busy_time_ns() += 100;
+    sim_TIM14.CNT = (uint32_t)(((sim_time_ns() + sim_rtos_busy_time_ns()) / 1000ull) % 1000ull);
+    return &sim_TIM14;
+}
+
+// @brief Returns the DWT register file with CYCCNT updated from the host
+// clock, if the cycle counter is enabled.
+DWT_Type* sim_cycle_counter(void) {
+    static uint64_t start_ns = 0;
+    uint64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (!(sim_DWT.CTRL & DWT_CTRL_CYCCNTENA_Msk))
+        start_ns = now_ns - sim_DWT.CYCCNT * 1000ull / (TIM_1_8_CLOCK_HZ / 1000000ull);
+    else
+        sim_DWT.CYCCNT = (uint32_t)((now_ns - start_ns) * (TIM_1_8_CLOCK_HZ / 1000000ull) / 1000ull);
+    return &sim_DWT;
+}
+
+/* GPIO ----------------------------------------------------------------------*/
+
+#define MAX_SUBSCRIPTIONS 10
+struct subscription_t {
+    GPIO_TypeDef* GPIO_port;
+    uint16_t GPIO_pin;
+    void (*callback)(void*);
+    void* ctx;
+};
+static subscription_t subscriptions[MAX_SUBSCRIPTIONS] = { 0 };
+static size_t n_subscriptions = 0;
+
+void HAL_GPIO_Init(GPIO_TypeDef* GPIOx, GPIO_InitTypeDef* GPIO_Init) {
+}
+
+void HAL_GPIO_DeInit(GPIO_TypeDef* GPIOx, uint32_t GPIO_Pin) {
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin) {
+    return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+// Gate driver chip select tracking to decode SPI writes
+struct drv8301_t {
+    GPIO_TypeDef* nCS_port;
+    uint16_t nCS_pin;
+    float gain;
+};
+static drv8301_t gate_drivers[] = {
+    { M0_nCS_GPIO_Port, M0_nCS_Pin, 10.0f },
+    { M1_nCS_GPIO_Port, M1_nCS_Pin, 10.0f },
+};
+static drv8301_t* selected_gate_driver = nullptr;
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState) {
+    if (PinState == GPIO_PIN_SET)
+        GPIOx->ODR |= GPIO_Pin;
+    else
+        GPIOx->ODR &= ~GPIO_Pin;
+
+    for (drv8301_t& drv : gate_drivers) {
+        if (drv.nCS_port == GPIOx && drv.nCS_pin == GPIO_Pin)
+            selected_gate_driver = (PinState == GPIO_PIN_RESET) ? &drv : nullptr;
+    }
+}
+
+void sim_gpio_set_input(GPIO_TypeDef* port, uint16_t pin, bool state) {
+    bool prev_state = port->IDR & pin;
+    if (state)
+        port->IDR |= pin;
+    else
+        port->IDR &= ~pin;
+
+    if (state && !prev_state) {
+        for (size_t i = 0; i < n_subscriptions; ++i) {
+            if (subscriptions[i].GPIO_port == port && subscriptions[i].GPIO_pin == pin
+                    && subscriptions[i].callback)
+                subscriptions[i].callback(subscriptions[i].ctx);
+        }
+    }
+}
+
+bool GPIO_subscribe(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin,
+        uint32_t pull_up_down, void (*callback)(void*), void* ctx) {
+    subscription_t* subscription = nullptr;
+    for (size_t i = 0; i < n_subscriptions; ++i) {
+        if (subscriptions[i].GPIO_port == GPIO_port && subscriptions[i].GPIO_pin == GPIO_pin)
+            subscription = &subscriptions[i];
+    }
+    if (!subscription) {
+        if (n_subscriptions >= MAX_SUBSCRIPTIONS)
+            return false;
+        subscription = &subscriptions[n_subscriptions++];
+    }
+    *subscription = { GPIO_port, GPIO_pin, callback, ctx };
+    return true;
+}
+
+void GPIO_unsubscribe(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin) {
+    for (size_t i = 0; i < n_subscriptions; ++i) {
+        if (subscriptions[i].GPIO_port == GPIO_port && subscriptions[i].GPIO_pin == GPIO_pin)
+            subscriptions[i].callback = nullptr;
+    }
+}
+
+void GPIO_set_to_analog(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin) {
+}
+
+void SetGPIO12toUART() {
+}
+
+GPIO_TypeDef* get_gpio_port_by_pin(uint16_t GPIO_pin) {
+    switch (GPIO_pin) {
+        case 1: return GPIO_1_GPIO_Port;
+        case 2: return GPIO_2_GPIO_Port;
+        case 3: return GPIO_3_GPIO_Port;
+        case 4: return GPIO_4_GPIO_Port;
+#ifdef GPIO_5_GPIO_Port
+        case 5: return GPIO_5_GPIO_Port;
+#endif
+#ifdef GPIO_6_GPIO_Port
+        case 6: return GPIO_6_GPIO_Port;
+#endif
+#ifdef GPIO_7_GPIO_Port
+        case 7: return GPIO_7_GPIO_Port;
+#endif
+#ifdef GPIO_8_GPIO_Port
+        case 8: return GPIO_8_GPIO_Port;
+#endif
+        default: return GPIO_1_GPIO_Port;
+    }
+}
+
+uint16_t get_gpio_pin_by_pin(uint16_t GPIO_pin) {
+    switch (GPIO_pin) {
+        case 1: return GPIO_1_Pin;
+        case 2: return GPIO_2_Pin;
+        case 3: return GPIO_3_Pin;
+        case 4: return GPIO_4_Pin;
+#ifdef GPIO_5_Pin
+        case 5: return GPIO_5_Pin;
+#endif
+#ifdef GPIO_6_Pin
+        case 6: return GPIO_6_Pin;
+#endif
+#ifdef GPIO_7_Pin
+        case 7: return GPIO_7_Pin;
+#endif
+#ifdef GPIO_8_Pin
+        case 8: return GPIO_8_Pin;
+#endif
+        default: return GPIO_1_Pin;
+    }
+}
+
+/* TIM -----------------------------------------------------------------------*/
+
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef* htim, uint32_t Channel) {
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Start_IT(TIM_HandleTypeDef* htim, uint32_t Channel) {
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIMEx_PWMN_Start(TIM_HandleTypeDef* htim, uint32_t Channel) {
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Encoder_Start(TIM_HandleTypeDef* htim, uint32_t Channel) {
+    htim->Instance->CR1 |= TIM_CR1_CEN;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_IC_ConfigChannel(TIM_HandleTypeDef* htim, TIM_IC_InitTypeDef* sConfig, uint32_t Channel) {
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_IC_Start_IT(TIM_HandleTypeDef* htim, uint32_t Channel) {
+    return HAL_OK;
+}
+
+/* DMA -----------------------------------------------------------------------*/
+
+// PAR and M0AR can't hold host pointers, so the addresses of the streams
+// are kept on the side
+struct DmaAddresses_t {
+    uintptr_t periph;
+    uintptr_t mem;
+};
+static DmaAddresses_t dma2_addresses[8];
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef* hdma) {
+    if (hdma->Init.Direction != DMA_PERIPH_TO_MEMORY)
+        return HAL_ERROR; // not modelled
+    hdma->Instance->CR = hdma->Init.Channel | hdma->Init.Direction
+            | hdma->Init.PeriphInc | hdma->Init.MemInc
+            | hdma->Init.PeriphDataAlignment | hdma->Init.MemDataAlignment
+            | hdma->Init.Mode | hdma->Init.Priority;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Start(DMA_HandleTypeDef* hdma, uintptr_t SrcAddress, uintptr_t DstAddress, uint32_t DataLength) {
+    size_t stream_num = hdma->Instance - sim_DMA2_Stream;
+    if (stream_num >= 8 || DataLength != 1)
+        return HAL_ERROR; // only single item transfers on DMA2 are modelled
+    dma2_addresses[stream_num] = { SrcAddress, DstAddress };
+    hdma->Instance->NDTR = DataLength;
+    hdma->Instance->CR |= DMA_SxCR_EN;
+    return HAL_OK;
+}
+
+void sim_dma2_request(size_t stream_num, uint32_t channel) {
+    DMA_Stream_TypeDef* stream = &sim_DMA2_Stream[stream_num];
+    if (!(stream->CR & DMA_SxCR_EN) || (stream->CR & DMA_SxCR_CHSEL) != channel)
+        return;
+    const DmaAddresses_t& addr = dma2_addresses[stream_num];
+    uint32_t data = (stream->CR & DMA_PDATAALIGN_WORD)
+            ? *reinterpret_cast<volatile uint32_t*>(addr.periph)
+            : *reinterpret_cast<volatile uint32_t*>(addr.periph) & 0xffff;
+    if (stream->CR & DMA_MDATAALIGN_WORD)
+        *reinterpret_cast<volatile uint32_t*>(addr.mem) = data;
+    else
+        *reinterpret_cast<volatile uint16_t*>(addr.mem) = (uint16_t)data;
+}
+
+/* ADC -----------------------------------------------------------------------*/
+
+static uint16_t* adc1_dma_buffer = nullptr;
+static uint32_t adc1_dma_length = 0;
+
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef* hadc) {
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef* hadc, ADC_ChannelConfTypeDef* sConfig) {
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef* hadc, uint32_t* pData, uint32_t Length) {
+    if (hadc->Instance == ADC1) {
+        adc1_dma_buffer = reinterpret_cast<uint16_t*>(pData);
+        adc1_dma_length = Length;
+    }
+    hadc->Instance->CR2 |= ADC_CR2_ADON;
+    return HAL_OK;
+}
+
+uint16_t* sim_adc1_dma_buffer(uint32_t* length) {
+    if (length)
+        *length = adc1_dma_length;
+    return adc1_dma_buffer;
+}
+
+uint32_t HAL_ADC_GetValue(ADC_HandleTypeDef* hadc) {
+    return hadc->Instance->DR;
+}
+
+uint32_t HAL_ADCEx_InjectedGetValue(ADC_HandleTypeDef* hadc, uint32_t InjectedRank) {
+    switch (InjectedRank) {
+        case 1: return hadc->Instance->JDR1;
+        case 2: return hadc->Instance->JDR2;
+        case 3: return hadc->Instance->JDR3;
+        case 4: return hadc->Instance->JDR4;
+        default: return 0;
+    }
+}
+
+/* SPI (DRV8301 gate drivers) ------------------------------------------------*/
+
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef* hspi, uint8_t* pData, uint16_t Size, uint32_t Timeout) {
+    // Control word: [15] R/W, [14:11] address, [10:0] data
+    uint16_t word = *reinterpret_cast<uint16_t*>(pData);
+    bool is_write = !(word & (1 << 15));
+    uint16_t addr = (word >> 11) & 0xf;
+    if (selected_gate_driver && is_write && addr == 0x3) {
+        static const float gains[] = { 10.0f, 20.0f, 40.0f, 80.0f };
+        selected_gate_driver->gain = gains[(word >> 2) & 0x3];
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef* hspi, uint8_t* pTxData, uint8_t* pRxData, uint16_t Size, uint32_t Timeout) {
+    for (uint16_t i = 0; i < Size; ++i)
+        reinterpret_cast<uint16_t*>(pRxData)[i] = 0;
+    return HAL_OK;
+}
+
+float sim_drv8301_gain(GPIO_TypeDef* nCS_port, uint16_t nCS_pin) {
+    for (drv8301_t& drv : gate_drivers) {
+        if (drv.nCS_port == nCS_port && drv.nCS_pin == nCS_pin)
+            return drv.gain;
+    }
+    return 10.0f;
+}
+
+/* Peripherals that are not simulated ----------------------------------------*/
+
+void MX_CAN1_Init(void) {
+}
+
+void MX_I2C1_Init(uint8_t addr) {
+}
@@ -0,0 +1,30 @@
+#ifndef __SIM_HAL_HPP
+#define __SIM_HAL_HPP
+
+#include <stm32f4xx_hal.h>
+#include <stdint.h>
+
+// Fills the CMSIS lookup tables. Must be called before any firmware code runs.
+void sim_init_tables();
+
+// Puts the peripheral registers into the state that the CubeMX generated
+// MX_*_Init() functions leave them in.
+void sim_init_peripherals();
+
+// Sets the logic level of an input pin and fires the EXTI callback that
+// was registered with GPIO_subscribe() on a rising edge.
+void sim_gpio_set_input(GPIO_TypeDef* port, uint16_t pin, bool state);
+
+// Serves a DMA request on the given DMA2 stream if the stream is enabled
+// and set to the given channel (DMA_CHANNEL_x).
+void sim_dma2_request(size_t stream_num, uint32_t channel);
+
+// Returns the buffer that was passed to HAL_ADC_Start_DMA() for ADC1, or
+// NULL if the DMA transfer has not been started yet.
+uint16_t* sim_adc1_dma_buffer(uint32_t* length);
+
+// Returns the current shunt amplifier gain [V/V] of the gate driver with
+// the given chip select pin, as last programmed over SPI.
+float sim_drv8301_gain(GPIO_TypeDef* nCS_port, uint16_t nCS_pin);
+
+#endif // __SIM_HAL_HPP
@@ -0,0 +1,542 @@
+/*
+* @brief Host-side simulation of the ODrive motor control firmware.
+*
+* Runs the unmodified control code (MotorControl/) against a simulated
+* STM32F405, DRV8301 and motor (see simulator.hpp). Usage:
+*
+*   odrive_sim [--scenario calibration|velocity_step|position_step|current_step|idle]
+*              [--duration <s>] [--precalibrated] [--noise <LSB>]
+*              [--seed <n>] [--trace <file.csv>]
+*              (see usage() for the remaining options)
+*/
+
+#define __MAIN_CPP__
+#include "odrive_main.h"
+
+#include "simulator.hpp"
+#include "sim_rtos.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+BoardConfig_t board_config;
+Encoder::Config_t encoder_configs[AXIS_COUNT];
+SensorlessEstimator::Config_t sensorless_configs[AXIS_COUNT];
+Controller::Config_t controller_configs[AXIS_COUNT];
+Motor::Config_t motor_configs[AXIS_COUNT];
+Axis::Config_t axis_configs[AXIS_COUNT];
+TrapezoidalTrajectory::Config_t trap_configs[AXIS_COUNT];
+bool user_config_loaded_;
+
+SystemStats_t system_stats_ = { 0 };
+
+Axis *axes[AXIS_COUNT];
+
+float oscilloscope[OSCILLOSCOPE_SIZE] = { 0 };
+size_t oscilloscope_pos = 0;
+
+void save_configuration(void) {
+    // There is no NVM in the simulation
+}
+
+// @brief Mirrors the parts of odrive_main() (MotorControl/main.cpp) that
+// concern motor control. Communication interfaces are not simulated.
+static void sim_odrive_main(void const* argument) {
+    (void)argument;
+
+    // Apply the PWM timing first since the objects below derive values from it.
+    // If the frequency is not supported, the default is used (see odrv.pwm_frequency).
+    configure_pwm(board_config.pwm_frequency, board_config.current_meas_every_pwm_period);
+
+    // Construct all objects.
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        Encoder *encoder = new Encoder(hw_configs[i].encoder_config,
+                                       encoder_configs[i]);
+        SensorlessEstimator *sensorless_estimator = new SensorlessEstimator(sensorless_configs[i]);
+        Controller *controller = new Controller(controller_configs[i]);
+        Motor *motor = new Motor(hw_configs[i].motor_config,
+                                 hw_configs[i].gate_driver_config,
+                                 motor_configs[i]);
+        TrapezoidalTrajectory *trap = new TrapezoidalTrajectory(trap_configs[i]);
+        axes[i] = new Axis(hw_configs[i].axis_config, axis_configs[i],
+                *encoder, *sensorless_estimator, *controller, *motor, *trap);
+    }
+
+    // Start ADC for temperature measurements and user measurements
+    start_general_purpose_adc();
+
+    // Start pwm-in compare modules
+    pwm_in_init();
+
+    // Setup hardware for all components
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        axes[i]->setup();
+    }
+
+    // Start PWM and enable adc interrupts/callbacks
+    profiler_init();
+    start_adc_pwm();
+
+    // Let the current sense calibration converge
+    osDelay(1500);
+
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        axes[i]->start_thread();
+    }
+
+    start_analog_thread();
+
+    system_stats_.fully_booted = true;
+}
+
+/* Scenarios -----------------------------------------------------------------*/
+
+enum Scenario_t {
+    SCENARIO_IDLE,
+    SCENARIO_CALIBRATION,
+    SCENARIO_VELOCITY_STEP,
+    SCENARIO_POSITION_STEP,
+    SCENARIO_CURRENT_STEP,
+};
+
+struct StepResponse_t {
+    float rise_time;         // [s] 10% to 90%
+    float overshoot;         // [%]
+    float settling_time;     // [s] until the response stays within 2%
+    float steady_state_error; // mean error over the last 10% of the window
+};
+
+static StepResponse_t analyze_step(const std::vector<float>& t, const std::vector<float>& y,
+                                   float t_step, float y0, float setpoint) {
+    StepResponse_t result = { NAN, 0.0f, NAN, NAN };
+    float span = setpoint - y0;
+    if (t.empty() || span == 0.0f)
+        return result;
+    float dir = span > 0.0f ? 1.0f : -1.0f;
+
+    float t10 = NAN, t90 = NAN;
+    float t_unsettled = t_step;
+    for (size_t i = 0; i < t.size(); ++i) {
+        float progress = (y[i] - y0) / span;
+        if (isnan(t10) && progress >= 0.1f)
+            t10 = t[i];
+        if (isnan(t90) && progress >= 0.9f)
+            t90 = t[i];
+        result.overshoot = std::max(result.overshoot, 100.0f * dir * (y[i] - setpoint) / fabsf(span));
+        if (fabsf(y[i] - setpoint) > 0.02f * fabsf(span))
+            t_unsettled = (i + 1 < t.size()) ? t[i + 1] : NAN;
+    }
+    result.rise_time = t90 - t10;
+    result.settling_time = t_unsettled - t_step;
+
+    size_t n_tail = std::max(t.size() / 10, (size_t)1);
+    float err_sum = 0.0f;
+    for (size_t i = t.size() - n_tail; i < t.size(); ++i)
+        err_sum += setpoint - y[i];
+    result.steady_state_error = err_sum / n_tail;
+    return result;
+}
+
+static const char* scenario_names[] = { "idle", "calibration", "velocity_step", "position_step", "current_step" };
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s [--scenario calibration|velocity_step|position_step|current_step|idle]\n"
+                    "          [--duration <s>] [--precalibrated] [--noise <LSB>]\n"
+                    "          [--seed <n>] [--trace <file.csv>] [--current-control-in-isr]\n"
+                    "          [--decimation <n>] [--pwm-frequency <Hz>]\n"
+                    "          [--current-meas-every-pwm-period] [--current-bandwidth <rad/s>]\n"
+                    "          [--vel-setpoint <counts/s>] [--current-control-decoupling]\n"
+                    "          [--back-emf-feedforward] [--mtpa] [--field-weakening]\n"
+                    "          [--motor-ld <H>] [--motor-lq <H>] [--max-modulation <ratio>]\n"
+                    "          [--overmodulation] [--dead-time <s>] [--dead-time-compensation]\n"
+                    "          [--dpwm] [--load-torque <Nm>] [--resistance-estimation]\n"
+                    "          [--winding-temp <degC>] [--thermal-model]\n"
+                    "          [--motor-saturation-current <A>] [--inductance-map]\n"
+                    "          [--calibration-fixed-length]\n", name);
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    Scenario_t scenario = SCENARIO_VELOCITY_STEP;
+    float duration = NAN;
+    float vel_setpoint = 10000.0f; // [counts/s] for the velocity_step scenario
+    float load_torque = 0.0f;      // [Nm] applied together with the step
+    float winding_temp = NAN;      // [degC] of the model, relative to the calibration at 25 degC
+    bool precalibrated = false;
+    bool inductance_map = false;   // run the inductance map calibration before the step
+    const char* trace_file = nullptr;
+    Simulator::Config_t sim_config;
+
+    for (int i = 1; i < argc; ++i) {
+        bool has_arg = i + 1 < argc;
+        if (!strcmp(argv[i], "--scenario") && has_arg) {
+            const char* name = argv[++i];
+            size_t n;
+            for (n = 0; n < sizeof(scenario_names) / sizeof(scenario_names[0]); ++n)
+                if (!strcmp(name, scenario_names[n]))
+                    break;
+            if (n == sizeof(scenario_names) / sizeof(scenario_names[0]))
+                usage(argv[0]);
+            scenario = (Scenario_t)n;
+        } else if (!strcmp(argv[i], "--duration") && has_arg) {
+            duration = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--precalibrated")) {
+            precalibrated = true;
+        } else if (!strcmp(argv[i], "--noise") && has_arg) {
+            sim_config.adc_noise_stddev = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && has_arg) {
+            sim_config.seed = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--trace") && has_arg) {
+            trace_file = argv[++i];
+        } else if (!strcmp(argv[i], "--current-control-in-isr")) {
+            motor_configs[0].current_control_in_isr = true;
+        } else if (!strcmp(argv[i], "--pwm-frequency") && has_arg) {
+            board_config.pwm_frequency = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--current-bandwidth") && has_arg) {
+            motor_configs[0].current_control_bandwidth = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--vel-setpoint") && has_arg) {
+            vel_setpoint = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--current-control-decoupling")) {
+            motor_configs[0].current_control_decoupling = true;
+        } else if (!strcmp(argv[i], "--back-emf-feedforward")) {
+            motor_configs[0].back_emf_feedforward = true;
+        } else if (!strcmp(argv[i], "--max-modulation") && has_arg) {
+            motor_configs[0].max_modulation = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--overmodulation")) {
+            motor_configs[0].overmodulation_enable = true;
+        } else if (!strcmp(argv[i], "--dead-time") && has_arg) {
+            sim_config.dead_time = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--dead-time-compensation")) {
+            motor_configs[0].dead_time_compensation_enable = true;
+        } else if (!strcmp(argv[i], "--load-torque") && has_arg) {
+            load_torque = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--resistance-estimation")) {
+            motor_configs[0].resistance_estimation_enable = true;
+        } else if (!strcmp(argv[i], "--motor-saturation-current") && has_arg) {
+            sim_config.axes[0].motor.saturation_current = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--calibration-fixed-length")) {
+            motor_configs[0].calibration_min_duration = motor_configs[0].calibration_max_duration;
+        } else if (!strcmp(argv[i], "--inductance-map")) {
+            inductance_map = true;
+        } else if (!strcmp(argv[i], "--thermal-model")) {
+            motor_configs[0].thermal_model_enable = true;
+        } else if (!strcmp(argv[i], "--winding-temp") && has_arg) {
+            winding_temp = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--dpwm")) {
+            motor_configs[0].modulation_type = Motor::MODULATION_TYPE_DPWM_MIN;
+        } else if (!strcmp(argv[i], "--mtpa")) {
+            motor_configs[0].mtpa_enable = true;
+        } else if (!strcmp(argv[i], "--field-weakening")) {
+            motor_configs[0].field_weakening_enable = true;
+        } else if (!strcmp(argv[i], "--motor-ld") && has_arg) {
+            sim_config.axes[0].motor.phase_inductance_d = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--motor-lq") && has_arg) {
+            sim_config.axes[0].motor.phase_inductance_q = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--current-meas-every-pwm-period")) {
+            board_config.current_meas_every_pwm_period = true;
+        } else if (!strcmp(argv[i], "--decimation") && has_arg) {
+            uint32_t decimation = strtoul(argv[++i], nullptr, 0);
+            axis_configs[0].encoder_decimation = decimation;
+            axis_configs[0].controller_decimation = decimation;
+            axis_configs[0].checks_decimation = decimation;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (isnan(duration))
+        duration = (scenario == SCENARIO_CALIBRATION) ? 15.0f :
+                   (scenario == SCENARIO_CURRENT_STEP) ? 0.02f : 1.0f;
+
+    // Default configuration (see load_configuration() in main.cpp)
+    for (size_t i = 0; i < AXIS_COUNT; ++i)
+        Axis::load_default_step_dir_pin_config(hw_configs[i].axis_config, &axis_configs[i]);
+
+    const Simulator::AxisConfig_t& sim_axis = sim_config.axes[0];
+    const MotorModel::Config_t& model = sim_axis.motor;
+    const float R_cal = model.phase_resistance; // at phase_resistance_ref_temp
+    encoder_configs[0].cpr = sim_axis.encoder_cpr;
+    motor_configs[0].pole_pairs = model.pole_pairs;
+    sensorless_configs[0].pm_flux_linkage = model.flux_linkage;
+    if (precalibrated) {
+        // The index pulse of the simulated encoder is aligned with the
+        // d-axis, so the encoder offset is zero.
+        motor_configs[0].pre_calibrated = true;
+        motor_configs[0].phase_resistance = R_cal;
+        motor_configs[0].phase_inductance = model.phase_inductance_q;
+        motor_configs[0].phase_inductance_saliency = model.phase_inductance_q - model.phase_inductance_d;
+        motor_configs[0].dead_time_voltage = sim_config.dead_time * board_config.pwm_frequency * sim_config.vbus_voltage;
+        motor_configs[0].direction = 1;
+        encoder_configs[0].use_index = true;
+        encoder_configs[0].pre_calibrated = true;
+        encoder_configs[0].offset = 0;
+        encoder_configs[0].offset_float = 0.0f;
+        axis_configs[0].startup_encoder_index_search = true;
+    } else {
+        axis_configs[0].startup_motor_calibration = true;
+        axis_configs[0].startup_encoder_offset_calibration = true;
+    }
+    bool is_step = scenario == SCENARIO_VELOCITY_STEP || scenario == SCENARIO_POSITION_STEP
+                || scenario == SCENARIO_CURRENT_STEP;
+    if (is_step && !inductance_map)
+        axis_configs[0].startup_closed_loop_control = true;
+    if (scenario == SCENARIO_VELOCITY_STEP) {
+        controller_configs[0].control_mode = Controller::CTRL_MODE_VELOCITY_CONTROL;
+        controller_configs[0].vel_limit = std::max(controller_configs[0].vel_limit, 1.2f * vel_setpoint);
+    }
+    if (scenario == SCENARIO_CURRENT_STEP)
+        controller_configs[0].control_mode = Controller::CTRL_MODE_CURRENT_CONTROL;
+    if (scenario == SCENARIO_IDLE) {
+        axis_configs[0].startup_motor_calibration = false;
+        axis_configs[0].startup_encoder_index_search = false;
+        axis_configs[0].startup_encoder_offset_calibration = false;
+    }
+
+    // A hot winding: the firmware is configured for the resistance at the
+    // reference temperature, the model runs with the increased resistance.
+    if (!isnan(winding_temp)) {
+        const Motor::Config_t& mc = motor_configs[0];
+        sim_config.axes[0].motor.phase_resistance = R_cal
+                * (1.0f + mc.phase_resistance_temp_coeff * (winding_temp - mc.phase_resistance_ref_temp));
+    }
+
+    Simulator sim(sim_config);
+    MotorModel& motor_model = sim.motors_[0];
+    const float counts_per_rad = (float)sim_axis.encoder_cpr / (2.0f * (float)M_PI);
+
+    FILE* trace = nullptr;
+    if (trace_file) {
+        trace = fopen(trace_file, "w");
+        if (!trace) {
+            perror(trace_file);
+            return 1;
+        }
+        fprintf(trace, "t,state,Iq_setpoint,Iq_measured,Id_measured,Iq_model,Id_model,"
+                       "vel_setpoint,vel_estimate,vel_model,pos_setpoint,pos_estimate,pos_model\n");
+    }
+
+    bool step_active = false;
+    float t_step = NAN;
+    std::vector<float> step_t, step_y;
+    double Id_err_sqr = 0.0, Iq_err_sqr = 0.0;
+
+    sim.on_current_meas = [&](size_t axis_num) {
+        if (axis_num != 0 || !axes[0])
+            return;
+        Axis& axis = *axes[0];
+        float vel_model = (float)motor_model.vel_ * counts_per_rad;
+        float pos_model = (float)motor_model.pos_ * counts_per_rad;
+        if (trace) {
+            fprintf(trace, "%.6f,%d,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g\n",
+                    sim.time(), (int)axis.current_state_,
+                    axis.motor_.current_control_.Iq_setpoint,
+                    axis.motor_.current_control_.Iq_measured,
+                    axis.motor_.current_control_.Id_measured,
+                    motor_model.iq_, motor_model.id_,
+                    axis.controller_.vel_setpoint_, axis.encoder_.vel_estimate_, vel_model,
+                    axis.controller_.pos_setpoint_, axis.encoder_.pos_estimate_, pos_model);
+        }
+        if (step_active) {
+            step_t.push_back(sim.time());
+            step_y.push_back(scenario == SCENARIO_VELOCITY_STEP ? vel_model :
+                             scenario == SCENARIO_CURRENT_STEP ? (float)motor_model.iq_ : pos_model);
+            // Current tracking error of the motor (the setpoint is the one
+            // the current controller worked with in the last cycle)
+            double Id_err = axis.motor_.current_control_.Id_setpoint - motor_model.id_;
+            double Iq_err = axis.motor_.current_control_.Iq_setpoint - motor_model.iq_;
+            Id_err_sqr += Id_err * Id_err;
+            Iq_err_sqr += Iq_err * Iq_err;
+        }
+    };
+
+    sim.boot(&sim_odrive_main);
+
+    // Wait until the firmware has finished booting
+    while (!system_stats_.fully_booted && sim.time() < 5.0)
+        sim.run_until(sim.time() + 1e-3);
+    float t_booted = sim.time();
+
+    // Wait for the startup sequence to finish
+    Axis& axis = *axes[0];
+    auto wait_for_state = [&](Axis::State_t state, double timeout) {
+        double t_start = sim.time();
+        while (!(axis.requested_state_ == Axis::AXIS_STATE_UNDEFINED && axis.current_state_ == state)
+                && sim.time() < t_start + timeout)
+            sim.run_until(sim.time() + 1e-3);
+    };
+    wait_for_state(axis_configs[0].startup_closed_loop_control ?
+            Axis::AXIS_STATE_CLOSED_LOOP_CONTROL : Axis::AXIS_STATE_IDLE, 30.0);
+    if (inductance_map) {
+        axis.requested_state_ = Axis::AXIS_STATE_INDUCTANCE_MAP_CALIBRATION;
+        wait_for_state(Axis::AXIS_STATE_IDLE, 30.0);
+        if (is_step) {
+            axis.requested_state_ = Axis::AXIS_STATE_CLOSED_LOOP_CONTROL;
+            wait_for_state(Axis::AXIS_STATE_CLOSED_LOOP_CONTROL, 1.0);
+        }
+    }
+    float t_ready = sim.time();
+
+    printf("scenario:               %s%s\n", scenario_names[scenario], precalibrated ? " (precalibrated)" : "");
+    printf("boot time:              %.3f s\n", t_booted);
+    printf("startup sequence:       %.3f s\n", t_ready - t_booted);
+
+    float y0 = 0.0f, setpoint = 0.0f;
+    double E_conduction_0 = 0.0, E_switching_0 = 0.0, E_copper_0 = 0.0;
+    if (is_step) {
+        if (axis.current_state_ == Axis::AXIS_STATE_CLOSED_LOOP_CONTROL) {
+            // Settle, then apply the step
+            sim.run_until(sim.time() + 0.5);
+            t_step = sim.time();
+            E_conduction_0 = sim.conduction_energy_[0];
+            E_switching_0 = sim.switching_energy_[0];
+            E_copper_0 = sim.copper_energy_[0];
+            motor_model.load_torque_ = load_torque;
+            if (scenario == SCENARIO_VELOCITY_STEP) {
+                y0 = (float)motor_model.vel_ * counts_per_rad;
+                setpoint = vel_setpoint;
+                axis.controller_.set_vel_setpoint(setpoint, 0.0f);
+            } else if (scenario == SCENARIO_CURRENT_STEP) {
+                // Lock the rotor so that the step response is not disturbed by
+                // back-EMF and the unloaded motor stays below the velocity limit.
+                motor_model.config_.inertia = 1e3f;
+                motor_model.vel_ = 0.0;
+                y0 = (float)motor_model.iq_;
+                setpoint = 5.0f;
+                axis.controller_.set_current_setpoint(setpoint);
+            } else {
+                y0 = (float)motor_model.pos_ * counts_per_rad;
+                setpoint = axis.controller_.pos_setpoint_ + (float)sim_axis.encoder_cpr;
+                axis.controller_.set_pos_setpoint(setpoint, 0.0f, 0.0f);
+                // The controller works relative to the encoder position
+                setpoint += y0 - axis.encoder_.pos_estimate_;
+            }
+            step_active = true;
+            sim.run_until(t_step + duration);
+        }
+    } else if (scenario == SCENARIO_IDLE) {
+        sim.run_until(sim.time() + duration);
+    }
+
+    if (trace)
+        fclose(trace);
+
+    printf("final state:            %d\n", (int)axis.current_state_);
+    printf("errors:                 axis 0x%04x motor 0x%04x encoder 0x%04x controller 0x%04x\n",
+           (unsigned)axis.error_, (unsigned)axis.motor_.error_,
+           (unsigned)axis.encoder_.error_, (unsigned)axis.controller_.error_);
+
+    if (scenario == SCENARIO_CALIBRATION) {
+        printf("phase resistance:       %.6f Ohm (model %.6f Ohm)\n",
+               axis.motor_.config_.phase_resistance, model.phase_resistance);
+        printf("phase inductance:       %.3e H (model %.3e H)\n",
+               axis.motor_.config_.phase_inductance, model.phase_inductance_q);
+        const Motor::CalibrationStats_t& stats = axis.motor_.calibration_stats_;
+        printf("calibration time:       resistance %.3f s (change %.1e), inductance %.3f s (change %.1e)\n",
+               stats.resistance_duration, stats.resistance_change,
+               stats.inductance_duration, stats.inductance_change);
+        printf("dead time voltage:      %.4f V (model %.4f V)\n",
+               axis.motor_.config_.dead_time_voltage, sim_config.dead_time * pwm_frequency * sim_config.vbus_voltage);
+        // Electrical phase of the model at encoder count 0
+        float count_at_zero = (float)motor_model.pos_ * counts_per_rad - axis.encoder_.shadow_count_;
+        float offset_err = (axis.encoder_.config_.offset + axis.encoder_.config_.offset_float - count_at_zero)
+                * (2.0f * (float)M_PI * model.pole_pairs / sim_axis.encoder_cpr);
+        offset_err = fmodf(offset_err + 3.0f * (float)M_PI, 2.0f * (float)M_PI) - (float)M_PI;
+        printf("encoder offset:         %d + %.3f counts (error %.4f rad electrical)\n",
+               (int)axis.encoder_.config_.offset, axis.encoder_.config_.offset_float, offset_err);
+    }
+
+    if (inductance_map) {
+        const Motor::InductanceMap_t& map = axis.motor_.config_.inductance_map;
+        printf("inductance map:         %s\n", map.enable ? "valid" : "invalid");
+        for (size_t i = 0; i < Motor::inductance_map_size; ++i) {
+            float I = map.max_current * (float)i / (float)(Motor::inductance_map_size - 1);
+            float sat = (float)motor_model.saturation_factor(I, 0.0);
+            printf("  %5.2f A:              Ld %.3e H, Lq %.3e H (model %.3e H, %.3e H)\n",
+                   I, map.Ld[i], map.Lq[i], sat * model.phase_inductance_d, sat * model.phase_inductance_q);
+        }
+    }
+
+    if (step_active) {
+        StepResponse_t res = analyze_step(step_t, step_y, t_step, y0, setpoint);
+        const char* unit = scenario == SCENARIO_VELOCITY_STEP ? "counts/s" :
+                           scenario == SCENARIO_CURRENT_STEP ? "A" : "counts";
+        printf("step:                   %g -> %g %s\n", y0, setpoint, unit);
+        printf("rise time (10-90%%):     %.2f ms\n", res.rise_time * 1e3f);
+        printf("overshoot:              %.2f %%\n", res.overshoot);
+        printf("settling time (2%%):     %.2f ms\n", res.settling_time * 1e3f);
+        printf("steady state error:     %g %s\n", res.steady_state_error, unit);
+        printf("current error (rms):    d %.4f A, q %.4f A\n",
+               sqrt(Id_err_sqr / step_t.size()), sqrt(Iq_err_sqr / step_t.size()));
+    }
+
+    // Last entries of the timing log, in PWM clocks within the current
+    // measurement period (TIM13 wraps once per period)
+    printf("timing log [clocks]:    ADC_CB_I %u, FOC_CURRENT %u, CURRENT_CMD %u\n",
+           axis.motor_.timing_log_[Motor::TIMING_LOG_ADC_CB_I],
+           axis.motor_.timing_log_[Motor::TIMING_LOG_FOC_CURRENT],
+           axis.motor_.timing_log_[Motor::TIMING_LOG_CURRENT_CMD]);
+    // The simulated cycle counter follows the host clock, except for
+    // isr_entry which is derived from the simulated TIM13
+    static const char* profiler_slot_names[Profiler::NUM_SLOTS] = {
+        "isr_entry", "current_meas_cb", "foc", "checks", "estimators",
+        "controller", "current_control", "control_loop", "preemption",
+    };
+    for (size_t i = 0; i < Profiler::NUM_SLOTS; ++i) {
+        const ProfilerSlot_t& slot = axis.profiler_.slots_[i];
+        printf("profiler %-15s %lu samples, min %lu, mean %.0f, max %lu cycles\n",
+               profiler_slot_names[i], (unsigned long)slot.count, (unsigned long)slot.min,
+               slot.mean, (unsigned long)slot.max);
+    }
+    FlightRecorder& recorder = axis.flight_recorder_;
+    if (recorder.count_) {
+        const FlightRecorder::Entry_t& last = recorder.get_entry(recorder.count_ - 1);
+        printf("flight recorder:        %lu entries, loop %lu..%lu, %s (axis error 0x%x, motor error 0x%x)\n",
+               (unsigned long)recorder.count_, (unsigned long)recorder.get_loop_counter(0),
+               (unsigned long)last.loop_counter, recorder.frozen_ ? "frozen" : "running",
+               last.axis_error, last.motor_error);
+    }
+    if (step_active) {
+        double t_window = sim.time() - t_step;
+        printf("inverter losses:        conduction %.3f W, switching %.3f W (average over the step)\n",
+               (sim.conduction_energy_[0] - E_conduction_0) / t_window,
+               (sim.switching_energy_[0] - E_switching_0) / t_window);
+        printf("copper losses:          %.3f W (average over the step)\n",
+               (sim.copper_energy_[0] - E_copper_0) / t_window);
+    }
+    printf("inverter temperature:   %.2f degC (model %.2f degC)\n",
+           axis.motor_.get_inverter_temp(), sim.inverter_temp_[0]);
+    if (axis.motor_.config_.thermal_model_enable) {
+        printf("motor thermal model:    winding %.2f degC, housing %.2f degC, copper losses %.3f W\n",
+               axis.motor_.thermal_model_.winding_temp, axis.motor_.thermal_model_.housing_temp,
+               axis.motor_.thermal_model_.copper_losses);
+    }
+    if (axis.motor_.config_.resistance_estimation_enable) {
+        printf("phase resistance est:   %.6f Ohm (model %.6f Ohm)\n",
+               axis.motor_.phase_resistance_est_, motor_model.config_.phase_resistance);
+        printf("winding temperature:    %.1f degC (model %.1f degC)\n",
+               axis.motor_.winding_temp_est_, isnan(winding_temp) ? axis.motor_.config_.phase_resistance_ref_temp : winding_temp);
+    }
+    printf("DC calibration:         phB %.4f A, phC %.4f A\n",
+           axis.motor_.DC_calib_.phB, axis.motor_.DC_calib_.phC);
+    printf("pwm frequency:          %.0f Hz (current loop %d Hz)\n", pwm_frequency, current_meas_hz);
+    printf("simulated time:         %.3f s\n", sim.time());
+    printf("interrupts:             %llu, avg %.0f ns, max %llu ns (host)\n",
+           (unsigned long long)sim.isr_count_,
+           sim.isr_count_ ? (double)sim.isr_host_ns_ / sim.isr_count_ : 0.0,
+           (unsigned long long)sim.isr_max_host_ns_);
+    SimThreadStats stats[8];
+    size_t n_threads = sim_rtos_get_thread_stats(stats, 8);
+    for (size_t i = 0; i < n_threads; ++i) {
+        printf("thread %-16s %llu runs, avg %.0f ns, max %llu ns (host)\n",
+               stats[i].name, (unsigned long long)stats[i].n_runs,
+               stats[i].n_runs ? (double)stats[i].host_ns / stats[i].n_runs : 0.0,
+               (unsigned long long)stats[i].max_host_ns);
+    }
+
+    // The firmware threads never return, so skip the static destructors
+    fflush(stdout);
+    _Exit(0);
+}
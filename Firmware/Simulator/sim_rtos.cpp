@@ -0,0 +1,226 @@
+/*
+* Deterministic CMSIS-RTOS emulation for the simulator.
+*
+* Every firmware thread is backed by a host thread, but a single baton
+* ensures that only one of them (or the scheduler, which also acts as the
+* interrupt context) runs at any point in time. Firmware code executes in
+* zero simulated time; the simulated clock is only advanced by the
+* scheduler while all threads are blocked in osDelay() or osSignalWait().
+* Consequently a simulation run only depends on its inputs and not on the
+* host's thread scheduling.
+*/
+
+#include "sim_rtos.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct SimThread {
+    enum State_t {
+        STATE_READY,
+        STATE_DELAYED,
+        STATE_WAITING_FOR_SIGNAL,
+        STATE_TERMINATED,
+    };
+
+    const char* name;
+    os_pthread fn;
+    void* arg;
+    int priority;
+    State_t state = STATE_READY;
+    uint64_t wake_time = UINT64_MAX; // [ns]
+    int32_t signals = 0;
+    int32_t wait_mask = 0;
+    osEvent result = {};
+    std::condition_variable cv;
+    SimThreadStats stats = {};
+    std::chrono::steady_clock::time_point resumed_at;
+};
+
+static std::mutex mutex_;
+static std::condition_variable scheduler_cv_;
+static SimThread* running_ = nullptr; // nullptr: scheduler/interrupt context
+static std::vector<SimThread*> threads_; // in order of creation
+static uint64_t time_ns_ = 0;
+static uint64_t busy_time_ns_ = 0;
+
+static thread_local SimThread* self_ = nullptr;
+
+uint64_t sim_time_ns() {
+    return time_ns_;
+}
+
+void sim_set_time_ns(uint64_t t) {
+    time_ns_ = t;
+}
+
+uint64_t& sim_rtos_busy_time_ns() {
+    return busy_time_ns_;
+}
+
+// @brief Hands the baton back to the scheduler and blocks until this
+// thread is scheduled again. Must be called with mutex_ held.
+static void yield_to_scheduler(std::unique_lock<std::mutex>& lock) {
+    SimThread* self = self_;
+    uint64_t run_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - self->resumed_at).count();
+    self->stats.n_runs++;
+    self->stats.host_ns += run_ns;
+    if (run_ns > self->stats.max_host_ns)
+        self->stats.max_host_ns = run_ns;
+
+    busy_time_ns_ = 0;
+    running_ = nullptr;
+    scheduler_cv_.notify_one();
+    self->cv.wait(lock, [self]{ return running_ == self; });
+    self->resumed_at = std::chrono::steady_clock::now();
+}
+
+static void thread_entry(SimThread* self) {
+    self_ = self;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        self->cv.wait(lock, [self]{ return running_ == self; });
+        self->resumed_at = std::chrono::steady_clock::now();
+    }
+
+    self->fn(self->arg);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    self->state = SimThread::STATE_TERMINATED;
+    running_ = nullptr;
+    scheduler_cv_.notify_one();
+}
+
+uint64_t sim_rtos_next_wakeup() {
+    uint64_t next = UINT64_MAX;
+    for (SimThread* t : threads_) {
+        if ((t->state == SimThread::STATE_DELAYED || t->state == SimThread::STATE_WAITING_FOR_SIGNAL)
+                && t->wake_time < next)
+            next = t->wake_time;
+    }
+    return next;
+}
+
+void sim_rtos_run_ready_threads() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    for (SimThread* t : threads_) {
+        if (t->wake_time > time_ns_)
+            continue;
+        if (t->state == SimThread::STATE_DELAYED) {
+            t->state = SimThread::STATE_READY;
+            t->result.status = osEventTimeout;
+        } else if (t->state == SimThread::STATE_WAITING_FOR_SIGNAL) {
+            t->state = SimThread::STATE_READY;
+            t->result.status = osEventTimeout;
+            t->result.value.signals = 0;
+        }
+    }
+
+    for (;;) {
+        // Pick the highest priority ready thread. Among threads of equal
+        // priority the one that was created first wins.
+        SimThread* next = nullptr;
+        for (SimThread* t : threads_) {
+            if (t->state == SimThread::STATE_READY && (!next || t->priority > next->priority))
+                next = t;
+        }
+        if (!next)
+            break;
+
+        next->wake_time = UINT64_MAX;
+        running_ = next;
+        next->cv.notify_one();
+        scheduler_cv_.wait(lock, []{ return running_ == nullptr; });
+    }
+}
+
+size_t sim_rtos_get_thread_stats(SimThreadStats* stats, size_t max_threads) {
+    size_t n = 0;
+    for (SimThread* t : threads_) {
+        if (n >= max_threads)
+            break;
+        stats[n] = t->stats;
+        stats[n].name = t->name;
+        ++n;
+    }
+    return n;
+}
+
+/* CMSIS-RTOS API ------------------------------------------------------------*/
+
+osThreadId osThreadCreate(const osThreadDef_t* thread_def, void* argument) {
+    SimThread* t = new SimThread();
+    t->name = thread_def->name;
+    t->fn = thread_def->pthread;
+    t->arg = argument;
+    t->priority = thread_def->tpriority;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        threads_.push_back(t);
+    }
+    // The host thread is never joined. The simulator terminates the process
+    // once the simulation is complete.
+    std::thread(thread_entry, t).detach();
+    return t;
+}
+
+osThreadId osThreadGetId(void) {
+    return self_;
+}
+
+osStatus osDelay(uint32_t millisec) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    SimThread* self = self_;
+    self->state = SimThread::STATE_DELAYED;
+    self->wake_time = time_ns_ + busy_time_ns_ + (uint64_t)millisec * 1000000ull;
+    yield_to_scheduler(lock);
+    return osOK;
+}
+
+int32_t osSignalSet(osThreadId thread_id, int32_t signals) {
+    if (!thread_id)
+        return (int32_t)0x80000000;
+    int32_t prev = thread_id->signals;
+    thread_id->signals |= signals;
+    if (thread_id->state == SimThread::STATE_WAITING_FOR_SIGNAL
+            && (thread_id->signals & thread_id->wait_mask)) {
+        thread_id->result.status = osEventSignal;
+        thread_id->result.value.signals = thread_id->signals & thread_id->wait_mask;
+        thread_id->signals &= ~thread_id->wait_mask;
+        thread_id->state = SimThread::STATE_READY;
+    }
+    return prev;
+}
+
+osEvent osSignalWait(int32_t signals, uint32_t millisec) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    SimThread* self = self_;
+    int32_t mask = signals ? signals : (int32_t)0x7fffffff;
+
+    osEvent result = {};
+    if (self->signals & mask) {
+        result.status = osEventSignal;
+        result.value.signals = self->signals & mask;
+        self->signals &= ~mask;
+        return result;
+    } else if (millisec == 0) {
+        result.status = osOK;
+        return result;
+    }
+
+    self->state = SimThread::STATE_WAITING_FOR_SIGNAL;
+    self->wait_mask = mask;
+    self->wake_time = (millisec == osWaitForever) ? UINT64_MAX
+            : time_ns_ + busy_time_ns_ + (uint64_t)millisec * 1000000ull;
+    yield_to_scheduler(lock);
+    return self->result;
+}
+
+uint32_t osKernelSysTick(void) {
+    return (uint32_t)((time_ns_ + busy_time_ns_) / 1000000ull);
+}
@@ -0,0 +1,37 @@
+#ifndef __SIM_RTOS_HPP
+#define __SIM_RTOS_HPP
+
+#include <cmsis_os.h>
+#include <stdint.h>
+
+// Simulated time since power-on [ns]
+uint64_t sim_time_ns();
+
+// Advances the simulated time. Must only be called from the scheduler
+// context (i.e. not from within a firmware thread).
+void sim_set_time_ns(uint64_t t);
+
+// Returns the time of the next thread wakeup (delay expiry or
+// signal timeout) or UINT64_MAX if no thread is waiting on a timeout.
+uint64_t sim_rtos_next_wakeup();
+
+// Wakes all threads whose timeout has expired and then runs all ready
+// threads (highest priority first) until every thread is blocked again.
+void sim_rtos_run_ready_threads();
+
+// Busy-wait time that the currently running thread has spent since it was
+// last scheduled [ns]. Busy-wait loops (delay_us()) make progress by
+// polling the time base which accumulates into this value.
+uint64_t& sim_rtos_busy_time_ns();
+
+// Host CPU time spent in a thread, used to estimate the cost of the
+// control loop iterations.
+struct SimThreadStats {
+    const char* name;
+    uint64_t n_runs;        // number of times the thread was scheduled
+    uint64_t host_ns;       // total host time spent in the thread [ns]
+    uint64_t max_host_ns;   // longest single run [ns]
+};
+size_t sim_rtos_get_thread_stats(SimThreadStats* stats, size_t max_threads);
+
+#endif // __SIM_RTOS_HPP
@@ -0,0 +1,418 @@
+#include "simulator.hpp"
+#include "sim_hal.hpp"
+#include "sim_rtos.hpp"
+
+#include <odrive_main.h>
+
+#include <algorithm>
+#include <chrono>
+
+/* Interrupt handlers --------------------------------------------------------*/
+
+// The following handlers mirror the ones in Board/v3/Src/stm32f4xx_it.c
+
+typedef void (*ADC_handler_t)(ADC_HandleTypeDef* hadc, bool injected);
+
+static void ADC_IRQ_Dispatch(ADC_HandleTypeDef* hadc, ADC_handler_t callback) {
+    // Injected measurements
+    uint32_t JEOC = __HAL_ADC_GET_FLAG(hadc, ADC_FLAG_JEOC);
+    uint32_t JEOC_IT_EN = __HAL_ADC_GET_IT_SOURCE(hadc, ADC_IT_JEOC);
+    if (JEOC && JEOC_IT_EN) {
+        callback(hadc, true);
+        __HAL_ADC_CLEAR_FLAG(hadc, (ADC_FLAG_JSTRT | ADC_FLAG_JEOC));
+    }
+    // Regular measurements
+    uint32_t EOC = __HAL_ADC_GET_FLAG(hadc, ADC_FLAG_EOC);
+    uint32_t EOC_IT_EN = __HAL_ADC_GET_IT_SOURCE(hadc, ADC_IT_EOC);
+    if (EOC && EOC_IT_EN) {
+        callback(hadc, false);
+        __HAL_ADC_CLEAR_FLAG(hadc, (ADC_FLAG_STRT | ADC_FLAG_EOC));
+    }
+}
+
+static void ADC_IRQHandler(void) {
+    ADC_IRQ_Dispatch(&hadc1, &vbus_sense_adc_cb);
+    // ADC3 signals the phB (ADC2) and phC (ADC3) samples together
+    ADC_IRQ_Dispatch(&hadc3, &pwm_trig_adc_cb);
+}
+
+static void TIM_UP_IRQHandler(TIM_HandleTypeDef* htim) {
+    __HAL_TIM_CLEAR_FLAG(htim, TIM_FLAG_UPDATE);
+}
+
+/* DMA requests --------------------------------------------------------------*/
+
+// DMA2 streams and channels of the TIM1 and TIM8 DMA requests (RM0090 table 43)
+struct TimDmaRequest_t {
+    uint32_t dier_bit;
+    bool is_cc;
+    size_t stream_num;
+    uint32_t channel;
+};
+static const TimDmaRequest_t tim1_dma_requests[] = {
+    { TIM_DIER_UDE, false, 5, DMA_CHANNEL_6 },
+    { TIM_DIER_CC1DE, true, 1, DMA_CHANNEL_6 },
+    { TIM_DIER_CC1DE, true, 3, DMA_CHANNEL_6 },
+    { TIM_DIER_CC2DE, true, 2, DMA_CHANNEL_6 },
+    { TIM_DIER_CC3DE, true, 6, DMA_CHANNEL_6 },
+    { TIM_DIER_CC4DE, true, 4, DMA_CHANNEL_6 },
+};
+static const TimDmaRequest_t tim8_dma_requests[] = {
+    { TIM_DIER_UDE, false, 1, DMA_CHANNEL_7 },
+    { TIM_DIER_CC1DE, true, 2, DMA_CHANNEL_7 },
+    { TIM_DIER_CC2DE, true, 3, DMA_CHANNEL_7 },
+    { TIM_DIER_CC3DE, true, 4, DMA_CHANNEL_7 },
+    { TIM_DIER_CC4DE, true, 7, DMA_CHANNEL_7 },
+};
+
+// @brief Issues the DMA requests of a timer update event. The CCx requests
+// are only issued on the update event if CR2.CCDS is set. Otherwise they
+// follow the compare matches, which are not modelled.
+static void tim_update_dma_requests(TIM_TypeDef* regs) {
+    const TimDmaRequest_t* requests = (regs == TIM1) ? tim1_dma_requests : tim8_dma_requests;
+    size_t n_requests = (regs == TIM1) ? sizeof(tim1_dma_requests) / sizeof(tim1_dma_requests[0])
+                                       : sizeof(tim8_dma_requests) / sizeof(tim8_dma_requests[0]);
+    for (size_t i = 0; i < n_requests; ++i) {
+        if (!(regs->DIER & requests[i].dier_bit))
+            continue;
+        if (requests[i].is_cc && !(regs->CR2 & TIM_CR2_CCDS))
+            continue;
+        sim_dma2_request(requests[i].stream_num, requests[i].channel);
+    }
+}
+
+/* Simulator -----------------------------------------------------------------*/
+
+Simulator::Simulator(const Config_t& config) :
+        config_(config),
+        motors_{ MotorModel(config.axes[0].motor), MotorModel(config.axes[1].motor) },
+        rng_(config.seed),
+        noise_(0.0f, 1.0f)
+{
+    pwm_timers_[0] = { &htim1 };
+    pwm_timers_[1] = { &htim8 };
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        inverter_temp_[i] = config.inverter_temperature;
+        thermistor_temp_[i] = NAN;
+    }
+}
+
+void Simulator::boot(void (*main_fn)(void const*)) {
+    sim_init_tables();
+    sim_init_peripherals();
+
+    update_sensors();
+
+    osThreadDef(defaultTask, main_fn, osPriorityNormal, 0, 512);
+    osThreadCreate(osThread(defaultTask), NULL);
+    sim_rtos_run_ready_threads();
+    start_timers_if_enabled();
+}
+
+double Simulator::time() const {
+    return (double)sim_time_ns() * 1e-9;
+}
+
+uint64_t Simulator::clocks_to_ns(const PwmTimer_t& tim, uint64_t clocks) const {
+    return tim.start_time + (uint64_t)((unsigned __int128)clocks * 1000000000u / TIM_1_8_CLOCK_HZ);
+}
+
+// @brief Starts the simulated counters once the firmware enables them.
+void Simulator::start_timers_if_enabled() {
+    uint64_t now = sim_time_ns();
+
+    // TIM8 is started by the trigger output of TIM1 (see sync_timers())
+    PwmTimer_t& tim1 = pwm_timers_[0];
+    if (!tim1.running && (TIM1->CR1 & TIM_CR1_CEN)) {
+        TIM8->CR1 |= TIM_CR1_CEN;
+        for (PwmTimer_t& tim : pwm_timers_) {
+            TIM_TypeDef* regs = tim.htim->Instance;
+            tim.running = true;
+            tim.start_time = now;
+            tim.start_cnt = regs->CNT;
+            tim.extreme_num = regs->RCR + 1;
+            tim.uev_clocks = (regs->RCR + 1) * regs->ARR - tim.start_cnt;
+            tim.active_ccr[0] = regs->CCR1;
+            tim.active_ccr[1] = regs->CCR2;
+            tim.active_ccr[2] = regs->CCR3;
+        }
+    }
+
+    if (!tim13_running_ && (TIM13->CR1 & TIM_CR1_CEN)) {
+        tim13_running_ = true;
+        tim13_start_time_ = now;
+        tim13_start_cnt_ = TIM13->CNT;
+    }
+}
+
+// @brief Updates the free running counters to the specified time
+void Simulator::update_counters(uint64_t t) {
+    for (PwmTimer_t& tim : pwm_timers_) {
+        if (!tim.running)
+            continue;
+        TIM_TypeDef* regs = tim.htim->Instance;
+        uint64_t clocks = (uint64_t)((unsigned __int128)(t - tim.start_time) * TIM_1_8_CLOCK_HZ / 1000000000u);
+        uint64_t pos = (tim.start_cnt + clocks) % (2 * regs->ARR);
+        if (pos < regs->ARR) {
+            regs->CNT = pos;
+            regs->CR1 &= ~TIM_CR1_DIR;
+        } else {
+            regs->CNT = 2 * regs->ARR - pos;
+            regs->CR1 |= TIM_CR1_DIR;
+        }
+    }
+
+    if (tim13_running_) {
+        uint64_t clocks = (uint64_t)((unsigned __int128)(t - tim13_start_time_) * TIM_APB1_CLOCK_HZ / 1000000000u);
+        TIM13->CNT = (tim13_start_cnt_ + clocks) % (TIM13->ARR + 1);
+    }
+}
+
+// @brief Updates the encoder, hall and thermistor inputs from the motor state
+void Simulator::update_sensors() {
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        const AxisConfig_t& axis_config = config_.axes[i];
+        const EncoderHardwareConfig_t& enc_hw = hw_configs[i].encoder_config;
+        MotorModel& motor = motors_[i];
+
+        if (axis_config.encoder_type == ENCODER_TYPE_INCREMENTAL) {
+            int64_t count = (int64_t)floor(motor.pos_ / (2.0 * M_PI) * axis_config.encoder_cpr);
+            enc_hw.timer->Instance->CNT = (uint32_t)count & 0xffff;
+            // Quadrature signals on the A and B pins
+            uint32_t phase = (uint32_t)count & 0x3;
+            sim_gpio_set_input(enc_hw.hallA_port, enc_hw.hallA_pin, phase == 1 || phase == 2);
+            sim_gpio_set_input(enc_hw.hallB_port, enc_hw.hallB_pin, phase == 2 || phase == 3);
+            // The index pulse is one count wide and located at position zero
+            int64_t count_in_cpr = count % axis_config.encoder_cpr;
+            if (count_in_cpr < 0)
+                count_in_cpr += axis_config.encoder_cpr;
+            sim_gpio_set_input(enc_hw.index_port, enc_hw.index_pin, count_in_cpr == 0);
+        } else if (axis_config.encoder_type == ENCODER_TYPE_HALL) {
+            static const uint8_t hall_states[6] = { 0b001, 0b011, 0b010, 0b110, 0b100, 0b101 };
+            double sector = floor((motor.electrical_angle() - axis_config.hall_offset) / (M_PI / 3.0));
+            int sector_idx = (int)fmod(sector, 6.0);
+            if (sector_idx < 0)
+                sector_idx += 6;
+            uint8_t state = hall_states[sector_idx];
+            sim_gpio_set_input(enc_hw.hallA_port, enc_hw.hallA_pin, state & 0b001);
+            sim_gpio_set_input(enc_hw.hallB_port, enc_hw.hallB_pin, state & 0b010);
+            sim_gpio_set_input(enc_hw.hallC_port, enc_hw.hallC_pin, state & 0b100);
+        }
+    }
+
+    // The thermistor reading is only recomputed when the temperature has
+    // changed noticeably
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        if (!(fabs(inverter_temp_[i] - thermistor_temp_[i]) < 0.01)) {
+            thermistor_temp_[i] = (float)inverter_temp_[i];
+            thermistor_adcval_[i] = temperature_to_adcval(thermistor_temp_[i]);
+        }
+    }
+
+    uint32_t n_adc_channels;
+    uint16_t* adc_buffer = sim_adc1_dma_buffer(&n_adc_channels);
+    if (adc_buffer) {
+        for (size_t i = 0; i < AXIS_COUNT; ++i) {
+            uint16_t ch = hw_configs[i].motor_config.inverter_thermistor_adc_ch;
+            if (ch < n_adc_channels)
+                adc_buffer[ch] = thermistor_adcval_[i];
+        }
+    }
+}
+
+// @brief Integrates the motor models up to time t with the currently active
+// inverter outputs.
+void Simulator::advance_to(uint64_t t) {
+    uint64_t now = sim_time_ns();
+    uint64_t max_step = std::max((uint64_t)(config_.max_step_size * 1e9f), (uint64_t)1);
+
+    while (now < t) {
+        uint64_t step = std::min(t - now, max_step);
+        for (size_t i = 0; i < AXIS_COUNT; ++i) {
+            const PwmTimer_t& tim = pwm_timers_[i];
+            TIM_TypeDef* regs = tim.htim->Instance;
+            bool enabled = tim.running && (regs->BDTR & TIM_BDTR_MOE);
+            double v_abc[3] = { 0.0, 0.0, 0.0 };
+            double P_conduction = 0.0, P_switching = 0.0;
+            if (enabled) {
+                double i_abc[3];
+                motors_[i].get_phase_currents(i_abc);
+                double pwm_freq = (double)TIM_1_8_CLOCK_HZ / (2.0 * regs->ARR);
+                for (size_t ph = 0; ph < 3; ++ph) {
+                    // PWM mode 2, center aligned: the high side is on while CNT > CCR
+                    double duty = 1.0 - (double)tim.active_ccr[ph] / (double)regs->ARR;
+                    bool switching = duty > 0.0 && duty < 1.0;
+                    // During the dead time both switches are off and the current
+                    // flows through a body diode, so the leg loses (or gains) one
+                    // dead time of high side on-time per PWM period.
+                    if (switching && i_abc[ph] != 0.0)
+                        duty -= copysign((double)config_.dead_time * pwm_freq, i_abc[ph]);
+                    duty = std::min(std::max(duty, 0.0), 1.0);
+                    v_abc[ph] = duty * config_.vbus_voltage;
+
+                    // One switch of the leg always conducts. A switching leg
+                    // turns on and off once per PWM period.
+                    P_conduction += config_.fet_rds_on * i_abc[ph] * i_abc[ph];
+                    if (switching)
+                        P_switching += config_.vbus_voltage * fabs(i_abc[ph]) * config_.fet_switching_time * pwm_freq;
+                }
+            }
+            motors_[i].step((double)step * 1e-9, v_abc, enabled);
+
+            double dt = (double)step * 1e-9;
+            conduction_energy_[i] += P_conduction * dt;
+            switching_energy_[i] += P_switching * dt;
+            copper_energy_[i] += 1.5 * motors_[i].config_.phase_resistance
+                    * (motors_[i].id_ * motors_[i].id_ + motors_[i].iq_ * motors_[i].iq_) * dt;
+            double P_ambient = (inverter_temp_[i] - config_.inverter_temperature) / config_.inverter_thermal_resistance;
+            inverter_temp_[i] += (P_conduction + P_switching - P_ambient) * dt / config_.inverter_heat_capacity;
+        }
+        now += step;
+        sim_set_time_ns(now);
+        update_sensors();
+    }
+    update_counters(now);
+}
+
+// @brief Finds the thermistor reading that corresponds to the given inverter
+// temperature by bisection of the (monotonic) polynomial used in
+// Motor::get_inverter_temp().
+uint16_t Simulator::temperature_to_adcval(float temp) {
+    float lo = 0.0f, hi = 1.0f;
+    bool increasing = horner_fma(1.0f, thermistor_poly_coeffs, thermistor_num_coeffs)
+                    > horner_fma(0.0f, thermistor_poly_coeffs, thermistor_num_coeffs);
+    for (int i = 0; i < 32; ++i) {
+        float mid = 0.5f * (lo + hi);
+        float mid_temp = horner_fma(mid, thermistor_poly_coeffs, thermistor_num_coeffs);
+        if ((mid_temp < temp) == increasing)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return (uint16_t)(0.5f * (lo + hi) * adc_full_scale + 0.5f);
+}
+
+uint16_t Simulator::current_to_adcval(size_t axis_num, double current, float offset) {
+    const BoardHardwareConfig_t& hw_config = hw_configs[axis_num];
+    float gain = sim_drv8301_gain(hw_config.gate_driver_config.nCS_port, hw_config.gate_driver_config.nCS_pin);
+    double shunt_volt = current / hw_config.motor_config.shunt_conductance;
+    double adcval = (double)(1 << 11) + shunt_volt * gain * (adc_full_scale / adc_ref_voltage) + offset;
+    if (config_.adc_noise_stddev > 0.0f)
+        adcval += config_.adc_noise_stddev * noise_(rng_);
+    adcval = std::min(std::max(round(adcval), 0.0), (double)((1 << 12) - 1));
+    return (uint16_t)adcval;
+}
+
+void Simulator::handle_update_event(PwmTimer_t& tim) {
+    TIM_TypeDef* regs = tim.htim->Instance;
+    size_t axis_num = (&tim == &pwm_timers_[0]) ? 0 : 1;
+    const AxisConfig_t& axis_config = config_.axes[axis_num];
+    bool at_top = tim.extreme_num & 1;
+
+    // The update event happens exactly at a counter extreme. Set the counter
+    // explicitly since the conversion to ns can be off by a clock cycle.
+    if (at_top) {
+        regs->CNT = regs->ARR;
+        regs->CR1 |= TIM_CR1_DIR;
+    } else {
+        regs->CNT = 0;
+        regs->CR1 &= ~TIM_CR1_DIR;
+    }
+
+    // Compare registers are preloaded and take effect on the update event
+    tim.active_ccr[0] = regs->CCR1;
+    tim.active_ccr[1] = regs->CCR2;
+    tim.active_ccr[2] = regs->CCR3;
+
+    // The update event triggers the ADC conversions. The low side shunts on
+    // phase B and C only carry the phase current while the low side switch
+    // is on. At the bottom of the counter all low side switches are on (SVM
+    // vector 0). At the top only phases that are clamped low (CCR >= ARR) are.
+    double i_abc[3] = { 0.0, 0.0, 0.0 };
+    motors_[axis_num].get_phase_currents(i_abc);
+    for (size_t ph = 0; ph < 3; ++ph) {
+        if (at_top && tim.active_ccr[ph] < regs->ARR)
+            i_abc[ph] = 0.0;
+    }
+    uint16_t adcval_phB = current_to_adcval(axis_num, i_abc[1], axis_config.adc_offset_phB);
+    uint16_t adcval_phC = current_to_adcval(axis_num, i_abc[2], axis_config.adc_offset_phC);
+
+    if (tim.htim == &htim1) {
+        // TIM1 TRGO triggers the injected conversions of ADC1 (vbus), ADC2 and ADC3
+        if (ADC1->CR2 & ADC_CR2_ADON) {
+            float vbus_sense = config_.vbus_voltage / VBUS_S_DIVIDER_RATIO;
+            ADC1->JDR1 = std::min((uint32_t)(vbus_sense * adc_full_scale / adc_ref_voltage + 0.5f), (uint32_t)((1 << 12) - 1));
+            ADC1->SR |= ADC_SR_JSTRT | ADC_SR_JEOC;
+        }
+        if (ADC2->CR2 & ADC_CR2_ADON) {
+            ADC2->JDR1 = adcval_phB;
+            ADC2->SR |= ADC_SR_JSTRT | ADC_SR_JEOC;
+        }
+        if (ADC3->CR2 & ADC_CR2_ADON) {
+            ADC3->JDR1 = adcval_phC;
+            ADC3->SR |= ADC_SR_JSTRT | ADC_SR_JEOC;
+        }
+    } else {
+        // TIM8 TRGO triggers the regular conversions of ADC2 and ADC3
+        if (ADC2->CR2 & ADC_CR2_ADON) {
+            ADC2->DR = adcval_phB;
+            ADC2->SR |= ADC_SR_STRT | ADC_SR_EOC;
+        }
+        if (ADC3->CR2 & ADC_CR2_ADON) {
+            ADC3->DR = adcval_phC;
+            ADC3->SR |= ADC_SR_STRT | ADC_SR_EOC;
+        }
+    }
+
+    // Schedule the next update event
+    tim.extreme_num += regs->RCR + 1;
+    tim.uev_clocks += (uint64_t)(regs->RCR + 1) * regs->ARR;
+
+    // The DMA transfers complete long before the ADC conversions
+    tim_update_dma_requests(regs);
+
+    auto start = std::chrono::steady_clock::now();
+    if (regs->DIER & TIM_DIER_UIE) {
+        regs->SR |= TIM_SR_UIF;
+        TIM_UP_IRQHandler(tim.htim);
+    }
+    ADC_IRQHandler();
+    uint64_t host_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    isr_count_++;
+    isr_host_ns_ += host_ns;
+    isr_max_host_ns_ = std::max(isr_max_host_ns_, host_ns);
+}
+
+void Simulator::run_until(double t) {
+    uint64_t t_end = (uint64_t)(t * 1e9);
+
+    while (sim_time_ns() < t_end) {
+        uint64_t next = std::min(t_end, sim_rtos_next_wakeup());
+        for (PwmTimer_t& tim : pwm_timers_) {
+            if (tim.running)
+                next = std::min(next, clocks_to_ns(tim, tim.uev_clocks));
+        }
+
+        advance_to(next);
+
+        bool current_sampled[2] = { false, false };
+        for (size_t i = 0; i < AXIS_COUNT; ++i) {
+            PwmTimer_t& tim = pwm_timers_[i];
+            if (tim.running && clocks_to_ns(tim, tim.uev_clocks) == next) {
+                current_sampled[i] = !(tim.extreme_num & 1);
+                handle_update_event(tim);
+            }
+        }
+
+        sim_rtos_run_ready_threads();
+        start_timers_if_enabled();
+
+        if (on_current_meas) {
+            for (size_t i = 0; i < AXIS_COUNT; ++i) {
+                if (current_sampled[i])
+                    on_current_meas(i);
+            }
+        }
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef __SIMULATOR_HPP
+#define __SIMULATOR_HPP
+
+#include "motor_model.hpp"
+
+#include <cmsis_os.h>
+#include <stm32f4xx_hal.h>
+
+#include <functional>
+#include <random>
+#include <stdint.h>
+
+// @brief Connects the simulated motors to the simulated peripherals and
+// steps the whole system forward in time.
+//
+// The simulator plays the role of the silicon: it advances the PWM timers,
+// latches the compare registers on every update event, samples the phase
+// currents and the bus voltage into the ADC data registers and dispatches the
+// same interrupt handlers as Board/v3/Src/stm32f4xx_it.c. Between interrupts
+// it runs the firmware threads until they block again (see sim_rtos.cpp).
+class Simulator {
+public:
+    enum EncoderType_t {
+        ENCODER_TYPE_INCREMENTAL,
+        ENCODER_TYPE_HALL,
+    };
+
+    struct AxisConfig_t {
+        MotorModel::Config_t motor;
+        EncoderType_t encoder_type = ENCODER_TYPE_INCREMENTAL;
+        int32_t encoder_cpr = 2048 * 4;  // [counts/rev] (after quadrature decoding)
+        float hall_offset = 0.0f;        // [rad] electrical angle of the first hall edge
+        float adc_offset_phB = 0.0f;     // [LSB] current sense amplifier offset
+        float adc_offset_phC = 0.0f;     // [LSB]
+    };
+
+    struct Config_t {
+        float vbus_voltage = 24.0f;        // [V]
+        float adc_noise_stddev = 0.0f;     // [LSB] gaussian noise on the current measurements
+        uint32_t seed = 1;                 // seed of the noise generator
+        float inverter_temperature = 25.0f; // [degC] ambient and initial temperature of the inverters
+        // Inverter losses and first order thermal model (per axis)
+        float fet_rds_on = 2e-3f;                 // [Ohm]
+        float fet_switching_time = 40e-9f;        // [s] rise plus fall time of one switching event
+        float inverter_thermal_resistance = 4.0f; // [K/W] to ambient
+        float inverter_heat_capacity = 2.0f;      // [J/K]
+        float max_step_size = 2e-6f;       // [s] maximum integration step of the motor model
+        float dead_time = 0.0f;            // [s] gate driver dead time (0 = ideal switches)
+        AxisConfig_t axes[2];
+    };
+
+    explicit Simulator(const Config_t& config);
+
+    // @brief Spawns the startup thread and powers up the simulated board.
+    // main_fn takes the role of the default task that calls odrive_main().
+    void boot(void (*main_fn)(void const*));
+
+    // @brief Runs the simulation until the specified point in time [s].
+    void run_until(double t);
+    double time() const;
+
+    // Called after each current measurement of the given axis, once all
+    // threads have finished processing it.
+    std::function<void(size_t axis_num)> on_current_meas;
+
+    Config_t config_;
+    MotorModel motors_[2];
+
+    // Inverter state and accumulated losses
+    double inverter_temp_[2];          // [degC]
+    double conduction_energy_[2] = {}; // [J]
+    double switching_energy_[2] = {};  // [J]
+    double copper_energy_[2] = {};     // [J] losses in the motor windings
+
+    // Host CPU time spent in interrupt handlers
+    uint64_t isr_count_ = 0;
+    uint64_t isr_host_ns_ = 0;
+    uint64_t isr_max_host_ns_ = 0;
+
+private:
+    struct PwmTimer_t {
+        TIM_HandleTypeDef* htim;
+        bool running;
+        uint64_t start_time;   // [ns]
+        uint32_t start_cnt;    // counter value at start
+        uint64_t uev_clocks;   // clock cycles from start until the next update event
+        uint64_t extreme_num;  // number of counter extremes until the next update event
+        uint32_t active_ccr[3]; // compare values latched at the last update event
+    };
+
+    uint64_t clocks_to_ns(const PwmTimer_t& tim, uint64_t clocks) const;
+    void start_timers_if_enabled();
+    void advance_to(uint64_t t);
+    void update_sensors();
+    void update_counters(uint64_t t);
+    void handle_update_event(PwmTimer_t& tim);
+    uint16_t current_to_adcval(size_t axis_num, double current, float offset);
+    uint16_t temperature_to_adcval(float temp);
+
+    PwmTimer_t pwm_timers_[2];
+    bool tim13_running_ = false;
+    uint64_t tim13_start_time_ = 0;
+    uint32_t tim13_start_cnt_ = 0;
+    uint16_t thermistor_adcval_[2] = {};
+    float thermistor_temp_[2];          // [degC] temperature that thermistor_adcval_ corresponds to
+    std::mt19937 rng_;
+    std::normal_distribution<float> noise_;
+};
+
+#endif // __SIMULATOR_HPP
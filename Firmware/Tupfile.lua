@@ -160,6 +160,7 @@ build{
         'MotorControl/utils.c',
         'MotorControl/arm_sin_f32.c',
         'MotorControl/arm_cos_f32.c',
+        'MotorControl/arm_sincos_f32.c',
         'MotorControl/low_level.cpp',
         'MotorControl/nvm.c',
         'MotorControl/axis.cpp',
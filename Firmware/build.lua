@@ -99,6 +99,8 @@ function GCCToolchain(prefix, builddir, compiler_flags, linker_flags)
             }
             -- display the size
             tup.frule{inputs={output_name..'.elf'}, command=prefix..'size %f'}
+            -- list the code placed in RAM and everything placed in CCM
+            tup.frule{inputs={output_name..'.elf'}, command='echo "RAM functions and CCM symbols:" && '..prefix..'nm -C -S -n %f | grep -E "^(20[0-9a-f]{6} [0-9a-f]{8} [tT]|10[0-9a-f]{6}) " || true'}
             -- generate disassembly
             tup.frule{inputs={output_name..'.elf'}, command=prefix..'objdump %f -dSC > %o', outputs={output_name..'.asm'}}
             -- create *.hex and *.bin output formats
@@ -128,6 +128,7 @@ static inline auto make_obj_tree() {
         make_protocol_ro_property("fw_version_unreleased", &fw_version_unreleased),
         make_protocol_ro_property("user_config_loaded", const_cast<const bool *>(&user_config_loaded_)),
         make_protocol_ro_property("brake_resistor_armed", &brake_resistor_armed),
+        make_protocol_ro_property("pwm_frequency", &pwm_frequency),
         make_protocol_object("system_stats",
             make_protocol_ro_property("uptime", &system_stats_.uptime),
             make_protocol_ro_property("min_heap_space", &system_stats_.min_heap_space),
@@ -158,6 +159,8 @@ static inline auto make_obj_tree() {
             make_protocol_property("enable_ascii_protocol_on_usb", &board_config.enable_ascii_protocol_on_usb),
             make_protocol_property("dc_bus_undervoltage_trip_level", &board_config.dc_bus_undervoltage_trip_level),
             make_protocol_property("dc_bus_overvoltage_trip_level", &board_config.dc_bus_overvoltage_trip_level),
+            make_protocol_property("pwm_frequency", &board_config.pwm_frequency), // requires a reboot
+            make_protocol_property("current_meas_every_pwm_period", &board_config.current_meas_every_pwm_period), // requires a reboot
 #if HW_VERSION_MAJOR == 3 && HW_VERSION_MINOR >= 3
             make_protocol_object("gpio1_pwm_mapping", make_protocol_definitions(board_config.pwm_mappings[0])),
             make_protocol_object("gpio2_pwm_mapping", make_protocol_definitions(board_config.pwm_mappings[1])),
@@ -8,10 +8,12 @@ see protocol.md for the protocol specification
 // TODO: resolve assert
 #define assert(expr)
 
+#include <array>
 #include <functional>
 #include <limits>
 #include <cmath>
 //#include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 #include "crc.hpp"
 #include "cpp_utils.hpp"
@@ -976,18 +978,16 @@ public:
         output_properties_.register_endpoints(list, id + 1 + decltype(input_properties_)::endpoint_count, length);
     }
 
-    template<typename> std::enable_if_t<sizeof...(TOutputs) == 0>
-    handle_ex() {
+    void handle_ex(std::integral_constant<size_t, 0>) {
         invoke_function_with_tuple(*obj_, func_ptr_, in_args_);
     }
 
-    template<typename> std::enable_if_t<sizeof...(TOutputs) == 1>
-    handle_ex() {
+    void handle_ex(std::integral_constant<size_t, 1>) {
         std::get<0>(out_args_) = invoke_function_with_tuple(*obj_, func_ptr_, in_args_);
     }
     
-    template<typename> std::enable_if_t<sizeof...(TOutputs) >= 2>
-    handle_ex() {
+    template<size_t N>
+    void handle_ex(std::integral_constant<size_t, N>) {
         out_args_ = invoke_function_with_tuple(*obj_, func_ptr_, in_args_);
     }
 
@@ -997,7 +997,7 @@ public:
         (void) output;
         LOG_FIBRE("tuple still at %x and of size %u\r\n", (uintptr_t)&in_args_, sizeof(in_args_));
         LOG_FIBRE("invoke function using %d and %.3f\r\n", std::get<0>(in_args_), std::get<1>(in_args_));
-        handle_ex<void>();
+        handle_ex(std::integral_constant<size_t, sizeof...(TOutputs)>());
     }
 
     const char * name_;
@@ -12,6 +12,7 @@ AXIS_STATE_ENCODER_OFFSET_CALIBRATION = 7
 AXIS_STATE_CLOSED_LOOP_CONTROL = 8
 AXIS_STATE_LOCKIN_SPIN = 9
 AXIS_STATE_ENCODER_DIR_FIND = 10
+AXIS_STATE_INDUCTANCE_MAP_CALIBRATION = 11
 
 class errors:
     class axis:
@@ -60,6 +61,9 @@ MOTOR_TYPE_HIGH_CURRENT = 0
 #MOTOR_TYPE_LOW_CURRENT = 1
 MOTOR_TYPE_GIMBAL = 2
 
+MODULATION_TYPE_SVM = 0
+MODULATION_TYPE_DPWM_MIN = 1
+
 CTRL_MODE_VOLTAGE_CONTROL = 0
 CTRL_MODE_CURRENT_CONTROL = 1
 CTRL_MODE_VELOCITY_CONTROL = 2
@@ -149,6 +149,28 @@ def show_oscilloscope(odrv):
     plt.plot(values)
     plt.show()
 
+flight_recorder_fields = [
+    'axis_error', 'motor_error',
+    'timing_adc_cb_i', 'timing_foc_current', 'timing_current_cmd',
+    'current_state', 'vbus_voltage', 'mod_alpha', 'mod_beta',
+    'Id_setpoint', 'Iq_setpoint', 'vel_setpoint', 'pos_setpoint']
+
+def dump_flight_recorder(axis):
+    """
+    Downloads the control loop flight recorder of an axis, oldest entry first.
+    Returns a list of dicts with the loop counter and the recorded fields.
+    """
+    recorder = axis.flight_recorder
+    if not recorder.frozen:
+        print("warning: the flight recorder is still running, entries may be overwritten while reading")
+    entries = []
+    for i in range(recorder.count):
+        entry = {'loop_counter': recorder.get_loop_counter(i)}
+        for field, name in enumerate(flight_recorder_fields):
+            entry[name] = recorder.get_val(i, field)
+        entries.append(entry)
+    return entries
+
 def rate_test(device):
     """
     Tests how many integers per second can be transmitted